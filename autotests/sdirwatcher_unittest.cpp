@@ -0,0 +1,244 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "../src/platformtheme/sdirwatcher.h"
+#include "stestdir.h"
+
+#include <QSignalSpy>
+#include <QTest>
+
+namespace
+{
+const QStringList s_directories = {QStringLiteral("a"), QStringLiteral("b"), QStringLiteral("c"), QStringLiteral("d")};
+}
+
+class SDirWatcherTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testEvictsLeastRecentlyUsed();
+    void testAddPathMarksUsed();
+    void testPinnedNotEvicted();
+    void testAllPinned();
+    void testUnpinnedGoesLast();
+    void testSetMaxWatches();
+    void testRemovePath();
+    void testRemoveAllPathsForgetsPins();
+    void testEntriesChanged();
+
+private:
+    static QStringList evictedPaths(const QSignalSpy &spy);
+};
+
+QStringList SDirWatcherTest::evictedPaths(const QSignalSpy &spy)
+{
+    QStringList paths;
+    for (const QList<QVariant> &arguments : spy) {
+        paths.append(arguments.at(0).toString());
+    }
+    return paths;
+}
+
+void SDirWatcherTest::testEvictsLeastRecentlyUsed()
+{
+    const STestDir dir(s_directories);
+    QVERIFY(dir.isValid());
+
+    SDirWatcher watcher;
+    watcher.setMaxWatches(2);
+    QSignalSpy spy(&watcher, &SDirWatcher::evicted);
+
+    watcher.addPath(dir.path(QStringLiteral("a")));
+    watcher.addPath(dir.path(QStringLiteral("b")));
+    QVERIFY(spy.isEmpty());
+
+    watcher.addPath(dir.path(QStringLiteral("c")));
+    QCOMPARE(evictedPaths(spy), QStringList{dir.path(QStringLiteral("a"))});
+    QVERIFY(!watcher.contains(dir.path(QStringLiteral("a"))));
+    QVERIFY(watcher.contains(dir.path(QStringLiteral("b"))));
+    QVERIFY(watcher.contains(dir.path(QStringLiteral("c"))));
+}
+
+void SDirWatcherTest::testAddPathMarksUsed()
+{
+    const STestDir dir(s_directories);
+    QVERIFY(dir.isValid());
+
+    SDirWatcher watcher;
+    watcher.setMaxWatches(2);
+    QSignalSpy spy(&watcher, &SDirWatcher::evicted);
+
+    watcher.addPath(dir.path(QStringLiteral("a")));
+    watcher.addPath(dir.path(QStringLiteral("b")));
+    watcher.addPath(dir.path(QStringLiteral("a")));
+    watcher.addPath(dir.path(QStringLiteral("c")));
+
+    QCOMPARE(evictedPaths(spy), QStringList{dir.path(QStringLiteral("b"))});
+    QVERIFY(watcher.contains(dir.path(QStringLiteral("a"))));
+}
+
+void SDirWatcherTest::testPinnedNotEvicted()
+{
+    const STestDir dir(s_directories);
+    QVERIFY(dir.isValid());
+
+    SDirWatcher watcher;
+    watcher.setMaxWatches(2);
+    QSignalSpy spy(&watcher, &SDirWatcher::evicted);
+
+    // Pinning works before the path is watched, too
+    watcher.setPinned(dir.path(QStringLiteral("a")), true);
+    watcher.addPath(dir.path(QStringLiteral("a")));
+    watcher.addPath(dir.path(QStringLiteral("b")));
+    watcher.addPath(dir.path(QStringLiteral("c")));
+    watcher.addPath(dir.path(QStringLiteral("d")));
+
+    QCOMPARE(evictedPaths(spy), (QStringList{dir.path(QStringLiteral("b")), dir.path(QStringLiteral("c"))}));
+    QVERIFY(watcher.contains(dir.path(QStringLiteral("a"))));
+    QVERIFY(watcher.contains(dir.path(QStringLiteral("d"))));
+}
+
+void SDirWatcherTest::testAllPinned()
+{
+    const STestDir dir(s_directories);
+    QVERIFY(dir.isValid());
+
+    SDirWatcher watcher;
+    watcher.setMaxWatches(2);
+    QSignalSpy spy(&watcher, &SDirWatcher::evicted);
+
+    for (const QString &name : {QStringLiteral("a"), QStringLiteral("b"), QStringLiteral("c")}) {
+        watcher.setPinned(dir.path(name), true);
+        watcher.addPath(dir.path(name));
+    }
+
+    // Rather over the limit than not watching an expanded folder
+    QVERIFY(spy.isEmpty());
+    QVERIFY(watcher.contains(dir.path(QStringLiteral("a"))));
+    QVERIFY(watcher.contains(dir.path(QStringLiteral("b"))));
+    QVERIFY(watcher.contains(dir.path(QStringLiteral("c"))));
+}
+
+void SDirWatcherTest::testUnpinnedGoesLast()
+{
+    const STestDir dir(s_directories);
+    QVERIFY(dir.isValid());
+
+    SDirWatcher watcher;
+    watcher.setMaxWatches(2);
+    QSignalSpy spy(&watcher, &SDirWatcher::evicted);
+
+    watcher.setPinned(dir.path(QStringLiteral("a")), true);
+    watcher.addPath(dir.path(QStringLiteral("a")));
+    watcher.addPath(dir.path(QStringLiteral("b")));
+
+    // Collapsed just now, so it's the most recently used
+    watcher.setPinned(dir.path(QStringLiteral("a")), false);
+    watcher.addPath(dir.path(QStringLiteral("c")));
+    QCOMPARE(evictedPaths(spy), QStringList{dir.path(QStringLiteral("b"))});
+
+    watcher.addPath(dir.path(QStringLiteral("d")));
+    QCOMPARE(evictedPaths(spy), (QStringList{dir.path(QStringLiteral("b")), dir.path(QStringLiteral("a"))}));
+}
+
+void SDirWatcherTest::testSetMaxWatches()
+{
+    const STestDir dir(s_directories);
+    QVERIFY(dir.isValid());
+
+    SDirWatcher watcher;
+    QSignalSpy spy(&watcher, &SDirWatcher::evicted);
+
+    watcher.setPinned(dir.path(QStringLiteral("b")), true);
+    for (const QString &name : {QStringLiteral("a"), QStringLiteral("b"), QStringLiteral("c"), QStringLiteral("d")}) {
+        watcher.addPath(dir.path(name));
+    }
+
+    watcher.setMaxWatches(2);
+    QCOMPARE(watcher.maxWatches(), 2);
+    QCOMPARE(evictedPaths(spy), (QStringList{dir.path(QStringLiteral("a")), dir.path(QStringLiteral("c"))}));
+
+    watcher.setMaxWatches(0);
+    QCOMPARE(watcher.maxWatches(), 1);
+    QCOMPARE(evictedPaths(spy), (QStringList{dir.path(QStringLiteral("a")), dir.path(QStringLiteral("c")), dir.path(QStringLiteral("d"))}));
+    QVERIFY(watcher.contains(dir.path(QStringLiteral("b"))));
+}
+
+void SDirWatcherTest::testRemovePath()
+{
+    const STestDir dir(s_directories);
+    QVERIFY(dir.isValid());
+
+    SDirWatcher watcher;
+    watcher.setMaxWatches(2);
+    QSignalSpy spy(&watcher, &SDirWatcher::evicted);
+
+    watcher.addPath(dir.path(QStringLiteral("a")));
+    watcher.addPath(dir.path(QStringLiteral("b")));
+    watcher.removePath(dir.path(QStringLiteral("a")));
+    QVERIFY(!watcher.contains(dir.path(QStringLiteral("a"))));
+
+    // There's room again, and removing isn't evicting
+    watcher.addPath(dir.path(QStringLiteral("c")));
+    QVERIFY(spy.isEmpty());
+}
+
+void SDirWatcherTest::testRemoveAllPathsForgetsPins()
+{
+    const STestDir dir(s_directories);
+    QVERIFY(dir.isValid());
+
+    SDirWatcher watcher;
+    watcher.setMaxWatches(1);
+    QSignalSpy spy(&watcher, &SDirWatcher::evicted);
+
+    watcher.setPinned(dir.path(QStringLiteral("a")), true);
+    watcher.addPath(dir.path(QStringLiteral("a")));
+    watcher.removeAllPaths();
+    QVERIFY(!watcher.contains(dir.path(QStringLiteral("a"))));
+
+    watcher.addPath(dir.path(QStringLiteral("a")));
+    watcher.addPath(dir.path(QStringLiteral("b")));
+    QCOMPARE(evictedPaths(spy), QStringList{dir.path(QStringLiteral("a"))});
+}
+
+void SDirWatcherTest::testEntriesChanged()
+{
+    const STestDir dir(s_directories);
+    QVERIFY(dir.isValid());
+
+    SDirWatcher watcher;
+    QSignalSpy spy(&watcher, &SDirWatcher::entriesChanged);
+    QSignalSpy relistSpy(&watcher, &SDirWatcher::directoryChanged);
+    const QString path = dir.path(QStringLiteral("a"));
+    watcher.addPath(path);
+
+    // A directory, a symlink to one and a plain file
+    QVERIFY(dir.mkpath(QStringLiteral("a/sub")));
+    QVERIFY(dir.link(QStringLiteral("b"), QStringLiteral("a/link")));
+    QVERIFY(dir.touch(QStringLiteral("a/file")));
+
+    if (!spy.wait(5000) && !relistSpy.isEmpty()) {
+        QSKIP("No inotify here, changes are only reported as a whole");
+    }
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(0).toString(), path);
+    QStringList added = spy.at(0).at(1).toStringList();
+    added.sort();
+    QCOMPARE(added, (QStringList{QStringLiteral("link"), QStringLiteral("sub")}));
+    QCOMPARE(spy.at(0).at(2).toStringList(), QStringList{QStringLiteral("file")});
+
+    spy.clear();
+    QVERIFY(dir.rmdir(QStringLiteral("a/sub")));
+    QVERIFY(spy.wait(5000));
+    QCOMPARE(spy.at(0).at(1).toStringList(), QStringList());
+    QCOMPARE(spy.at(0).at(2).toStringList(), QStringList{QStringLiteral("sub")});
+}
+
+QTEST_GUILESS_MAIN(SDirWatcherTest)
+
+#include "sdirwatcher_unittest.moc"
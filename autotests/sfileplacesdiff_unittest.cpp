@@ -0,0 +1,140 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-only
+*/
+
+#include "../src/platformtheme/sfileplacesdiff_p.h"
+
+#include <QDebug>
+#include <QRandomGenerator>
+#include <QTest>
+
+#include <algorithm>
+
+using SFilePlacesDiff::Plan;
+using SFilePlacesDiff::Range;
+
+namespace
+{
+// Applies @p plan to @p rows the way the model does, checking every step
+// is one a model could signal
+QVector<quint64> apply(const Plan &plan, QVector<quint64> rows, const QVector<quint64> &newIds)
+{
+    for (const Range &removal : plan.removals) {
+        if (removal.first < 0 || removal.last < removal.first || removal.last >= rows.count()) {
+            qWarning() << "bad removal" << removal.first << removal.last;
+            return {};
+        }
+        rows.remove(removal.first, removal.last - removal.first + 1);
+    }
+
+    for (const Range &move : plan.moves) {
+        if (move.first < 0 || move.last < move.first || move.last >= rows.count() //
+            || move.destination < 0 || move.destination > rows.count() //
+            || (move.destination >= move.first && move.destination <= move.last + 1)) {
+            qWarning() << "bad move" << move.first << move.last << move.destination;
+            return {};
+        }
+        SFilePlacesDiff::moveRange(rows, move);
+    }
+
+    if (plan.targets.count() != rows.count()) {
+        qWarning() << "targets don't match the rows left";
+        return {};
+    }
+    for (int row = 0; row < rows.count(); ++row) {
+        if (newIds.at(plan.targets.at(row)) != rows.at(row)) {
+            qWarning() << "row" << row << "isn't going to" << plan.targets.at(row);
+            return {};
+        }
+    }
+
+    for (const Range &insertion : plan.insertions) {
+        if (insertion.first < 0 || insertion.last < insertion.first || insertion.first > rows.count()) {
+            qWarning() << "bad insertion" << insertion.first << insertion.last;
+            return {};
+        }
+        for (int row = insertion.first; row <= insertion.last; ++row) {
+            rows.insert(row, newIds.at(row));
+        }
+    }
+    return rows;
+}
+}
+
+class SFilePlacesDiffTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testDiff_data();
+    void testDiff();
+    void testRandom();
+};
+
+void SFilePlacesDiffTest::testDiff_data()
+{
+    QTest::addColumn<QVector<quint64>>("oldIds");
+    QTest::addColumn<QVector<quint64>>("newIds");
+    QTest::addColumn<int>("removals");
+    QTest::addColumn<int>("moves");
+    QTest::addColumn<int>("insertions");
+
+    QTest::newRow("unchanged") << QVector<quint64>{1, 2, 3} << QVector<quint64>{1, 2, 3} << 0 << 0 << 0;
+    QTest::newRow("empty") << QVector<quint64>{} << QVector<quint64>{} << 0 << 0 << 0;
+    QTest::newRow("all new") << QVector<quint64>{} << QVector<quint64>{1, 2, 3} << 0 << 0 << 1;
+    QTest::newRow("all gone") << QVector<quint64>{1, 2, 3} << QVector<quint64>{} << 1 << 0 << 0;
+    QTest::newRow("removed ranges") << QVector<quint64>{1, 2, 3, 4, 5, 6} << QVector<quint64>{1, 4, 6} << 2 << 0 << 0;
+    QTest::newRow("inserted ranges") << QVector<quint64>{1, 4, 6} << QVector<quint64>{1, 2, 3, 4, 5, 6} << 0 << 0 << 2;
+    QTest::newRow("one moved") << QVector<quint64>{1, 2, 3, 4} << QVector<quint64>{2, 3, 4, 1} << 0 << 1 << 0;
+    QTest::newRow("block moved") << QVector<quint64>{1, 2, 3, 4, 5} << QVector<quint64>{4, 5, 1, 2, 3} << 0 << 1 << 0;
+    QTest::newRow("reversed") << QVector<quint64>{1, 2, 3, 4} << QVector<quint64>{4, 3, 2, 1} << 0 << 3 << 0;
+    QTest::newRow("everything") << QVector<quint64>{1, 2, 3, 4, 5} << QVector<quint64>{6, 4, 5, 1, 3} << 1 << 1 << 1;
+    QTest::newRow("duplicate ids") << QVector<quint64>{1, 1, 2} << QVector<quint64>{2, 1, 1, 1} << 1 << 1 << 1;
+}
+
+void SFilePlacesDiffTest::testDiff()
+{
+    QFETCH(QVector<quint64>, oldIds);
+    QFETCH(QVector<quint64>, newIds);
+    QFETCH(int, removals);
+    QFETCH(int, moves);
+    QFETCH(int, insertions);
+
+    const Plan plan = SFilePlacesDiff::diff(oldIds, newIds);
+    QCOMPARE(apply(plan, oldIds, newIds), newIds);
+    QCOMPARE(plan.removals.count(), removals);
+    QCOMPARE(plan.moves.count(), moves);
+    QCOMPARE(plan.insertions.count(), insertions);
+}
+
+void SFilePlacesDiffTest::testRandom()
+{
+    QRandomGenerator random(42);
+    for (int i = 0; i < 2000; ++i) {
+        QVector<quint64> oldIds;
+        QVector<quint64> newIds;
+        const int oldCount = random.bounded(16);
+        const int newCount = random.bounded(16);
+        for (int row = 0; row < oldCount; ++row) {
+            oldIds.append(random.bounded(20));
+        }
+        if (i % 2) {
+            // Mostly the same places, like most reloads
+            newIds = oldIds;
+            std::shuffle(newIds.begin(), newIds.end(), random);
+        } else {
+            for (int row = 0; row < newCount; ++row) {
+                newIds.append(random.bounded(20));
+            }
+        }
+
+        const Plan plan = SFilePlacesDiff::diff(oldIds, newIds);
+        QCOMPARE(apply(plan, oldIds, newIds), newIds);
+    }
+}
+
+QTEST_GUILESS_MAIN(SFilePlacesDiffTest)
+
+#include "sfileplacesdiff_unittest.moc"
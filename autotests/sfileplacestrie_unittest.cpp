@@ -0,0 +1,163 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-only
+*/
+
+#include "../src/platformtheme/sfileplacestrie_p.h"
+
+#include <QTest>
+
+namespace
+{
+// The trie never looks at the items, any distinct pointers do
+char s_items[4];
+
+SFilePlacesItem *item(int i)
+{
+    return reinterpret_cast<SFilePlacesItem *>(&s_items[i]);
+}
+
+struct Visit {
+    QVector<SFilePlacesItem *> items;
+    bool exact;
+};
+
+QVector<Visit> findParents(const SFilePlacesTrie &trie, const QUrl &url, int stopAfter = -1)
+{
+    QVector<Visit> visits;
+    trie.findParents(url, [&visits, stopAfter](const QVector<SFilePlacesItem *> &items, bool exact) {
+        visits.append({items, exact});
+        return visits.count() == stopAfter;
+    });
+    return visits;
+}
+}
+
+class SFilePlacesTrieTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testFindParents();
+    void testExact();
+    void testStop();
+    void testSchemeAndAuthority();
+    void testSameUrl();
+    void testMoveAndRemove();
+};
+
+void SFilePlacesTrieTest::testFindParents()
+{
+    SFilePlacesTrie trie;
+    trie.insert(item(0), QUrl::fromLocalFile(QStringLiteral("/")));
+    trie.insert(item(1), QUrl::fromLocalFile(QStringLiteral("/home/user")));
+    trie.insert(item(2), QUrl::fromLocalFile(QStringLiteral("/home/user/Documents")));
+
+    // Deepest first, and only the nodes that have items
+    const QVector<Visit> visits = findParents(trie, QUrl::fromLocalFile(QStringLiteral("/home/user/Documents/letter.odt")));
+    QCOMPARE(visits.count(), 3);
+    QCOMPARE(visits.at(0).items, QVector<SFilePlacesItem *>{item(2)});
+    QVERIFY(!visits.at(0).exact);
+    QCOMPARE(visits.at(1).items, QVector<SFilePlacesItem *>{item(1)});
+    QVERIFY(!visits.at(1).exact);
+    QCOMPARE(visits.at(2).items, QVector<SFilePlacesItem *>{item(0)});
+    QVERIFY(!visits.at(2).exact);
+
+    // A sibling with a common prefix isn't below the place
+    const QVector<Visit> sibling = findParents(trie, QUrl::fromLocalFile(QStringLiteral("/home/username")));
+    QCOMPARE(sibling.count(), 1);
+    QCOMPARE(sibling.at(0).items, QVector<SFilePlacesItem *>{item(0)});
+}
+
+void SFilePlacesTrieTest::testExact()
+{
+    SFilePlacesTrie trie;
+    trie.insert(item(0), QUrl::fromLocalFile(QStringLiteral("/home")));
+    trie.insert(item(1), QUrl::fromLocalFile(QStringLiteral("/home/user")));
+
+    QVector<Visit> visits = findParents(trie, QUrl::fromLocalFile(QStringLiteral("/home/user")));
+    QCOMPARE(visits.count(), 2);
+    QVERIFY(visits.at(0).exact);
+    QVERIFY(!visits.at(1).exact);
+
+    // Empty components don't count
+    visits = findParents(trie, QUrl(QStringLiteral("file:///home//user/")));
+    QCOMPARE(visits.count(), 2);
+    QVERIFY(visits.at(0).exact);
+    QCOMPARE(visits.at(0).items, QVector<SFilePlacesItem *>{item(1)});
+}
+
+void SFilePlacesTrieTest::testStop()
+{
+    SFilePlacesTrie trie;
+    trie.insert(item(0), QUrl::fromLocalFile(QStringLiteral("/")));
+    trie.insert(item(1), QUrl::fromLocalFile(QStringLiteral("/home/user")));
+
+    const QVector<Visit> visits = findParents(trie, QUrl::fromLocalFile(QStringLiteral("/home/user/file")), 1);
+    QCOMPARE(visits.count(), 1);
+    QCOMPARE(visits.at(0).items, QVector<SFilePlacesItem *>{item(1)});
+}
+
+void SFilePlacesTrieTest::testSchemeAndAuthority()
+{
+    SFilePlacesTrie trie;
+    trie.insert(item(0), QUrl::fromLocalFile(QStringLiteral("/home/user")));
+    trie.insert(item(1), QUrl(QStringLiteral("sftp://server/home/user")));
+
+    QVector<Visit> visits = findParents(trie, QUrl(QStringLiteral("sftp://server/home/user/file")));
+    QCOMPARE(visits.count(), 1);
+    QCOMPARE(visits.at(0).items, QVector<SFilePlacesItem *>{item(1)});
+
+    QVERIFY(findParents(trie, QUrl(QStringLiteral("sftp://other/home/user/file"))).isEmpty());
+    QVERIFY(findParents(trie, QUrl(QStringLiteral("sftp://me@server/home/user"))).isEmpty());
+
+    visits = findParents(trie, QUrl::fromLocalFile(QStringLiteral("/home/user/file")));
+    QCOMPARE(visits.count(), 1);
+    QCOMPARE(visits.at(0).items, QVector<SFilePlacesItem *>{item(0)});
+}
+
+void SFilePlacesTrieTest::testSameUrl()
+{
+    SFilePlacesTrie trie;
+    trie.insert(item(0), QUrl::fromLocalFile(QStringLiteral("/media/stick")));
+    trie.insert(item(1), QUrl::fromLocalFile(QStringLiteral("/media/stick")));
+
+    const QVector<Visit> visits = findParents(trie, QUrl::fromLocalFile(QStringLiteral("/media/stick")));
+    QCOMPARE(visits.count(), 1);
+    QCOMPARE(visits.at(0).items, (QVector<SFilePlacesItem *>{item(0), item(1)}));
+    QVERIFY(visits.at(0).exact);
+}
+
+void SFilePlacesTrieTest::testMoveAndRemove()
+{
+    SFilePlacesTrie trie;
+    trie.insert(item(0), QUrl::fromLocalFile(QStringLiteral("/home")));
+    trie.insert(item(1), QUrl::fromLocalFile(QStringLiteral("/home/user/Documents")));
+
+    // Inserting again moves it, like a device mounted somewhere else
+    trie.insert(item(1), QUrl::fromLocalFile(QStringLiteral("/mnt/data")));
+    QVector<Visit> visits = findParents(trie, QUrl::fromLocalFile(QStringLiteral("/home/user/Documents")));
+    QCOMPARE(visits.count(), 1);
+    QCOMPARE(visits.at(0).items, QVector<SFilePlacesItem *>{item(0)});
+    visits = findParents(trie, QUrl::fromLocalFile(QStringLiteral("/mnt/data/file")));
+    QCOMPARE(visits.count(), 1);
+    QCOMPARE(visits.at(0).items, QVector<SFilePlacesItem *>{item(1)});
+
+    trie.remove(item(1));
+    QVERIFY(findParents(trie, QUrl::fromLocalFile(QStringLiteral("/mnt/data/file"))).isEmpty());
+
+    // Removing what isn't in is fine
+    trie.remove(item(2));
+
+    trie.remove(item(0));
+    QVERIFY(findParents(trie, QUrl::fromLocalFile(QStringLiteral("/home"))).isEmpty());
+
+    trie.insert(item(0), QUrl::fromLocalFile(QStringLiteral("/home")));
+    trie.clear();
+    QVERIFY(findParents(trie, QUrl::fromLocalFile(QStringLiteral("/home"))).isEmpty());
+}
+
+QTEST_GUILESS_MAIN(SFilePlacesTrieTest)
+
+#include "sfileplacestrie_unittest.moc"
@@ -0,0 +1,250 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "../src/platformtheme/slocaldirmodel.h"
+#include "stestdir.h"
+
+#include <QDir>
+#include <QFile>
+#include <QIcon>
+#include <QSignalSpy>
+#include <QTest>
+
+#include <kdirmodel.h>
+#include <kfileitem.h>
+
+#include <sys/stat.h>
+
+namespace
+{
+// a/sub/deep, .hidden, a symlink to a and a plain file
+bool populate(const STestDir &dir)
+{
+    return dir.isValid() && dir.mkpath(QStringLiteral("a/sub/deep")) && dir.mkpath(QStringLiteral(".hidden"))
+        && dir.link(QStringLiteral("a"), QStringLiteral("link")) && dir.touch(QStringLiteral("file"));
+}
+
+QStringList rowNames(const SLocalDirModel &model, const QModelIndex &parent = QModelIndex())
+{
+    QStringList names;
+    for (int row = 0; row < model.rowCount(parent); ++row) {
+        names.append(model.index(row, 0, parent).data().toString());
+    }
+    names.sort();
+    return names;
+}
+}
+
+class SLocalDirModelTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testOnlyDirectories();
+    void testFetchMore();
+    void testUrls();
+    void testData();
+    void testExpandToUrl();
+    void testExpandToNewDirectory();
+    void testWatcher();
+    void testOpenUrlDropsOldListings();
+};
+
+void SLocalDirModelTest::testOnlyDirectories()
+{
+    const STestDir dir;
+    QVERIFY(populate(dir));
+
+    SLocalDirModel model;
+    model.openUrl(QUrl::fromLocalFile(dir.path()));
+    QCOMPARE(model.rootUrl(), QUrl::fromLocalFile(dir.path()));
+
+    // Hidden ones are left to the proxy
+    QTRY_COMPARE(rowNames(model), (QStringList{QStringLiteral(".hidden"), QStringLiteral("a"), QStringLiteral("link")}));
+    QCOMPARE(model.columnCount(), 1);
+}
+
+void SLocalDirModelTest::testFetchMore()
+{
+    const STestDir dir;
+    QVERIFY(populate(dir));
+
+    SLocalDirModel model;
+    model.openUrl(QUrl::fromLocalFile(dir.path()));
+    QTRY_COMPARE(model.rowCount(), 3);
+
+    // Expandable until we know better
+    const QModelIndex a = model.indexForUrl(QUrl::fromLocalFile(dir.path(QStringLiteral("a"))));
+    QVERIFY(a.isValid());
+    QVERIFY(model.hasChildren(a));
+    QVERIFY(model.canFetchMore(a));
+    QCOMPARE(model.rowCount(a), 0);
+
+    model.fetchMore(a);
+    QVERIFY(!model.canFetchMore(a));
+    QTRY_COMPARE(rowNames(model, a), QStringList{QStringLiteral("sub")});
+
+    const QModelIndex hidden = model.indexForUrl(QUrl::fromLocalFile(dir.path(QStringLiteral(".hidden"))));
+    model.fetchMore(hidden);
+    QTRY_VERIFY(!model.hasChildren(hidden));
+    QVERIFY(!model.canFetchMore(hidden));
+}
+
+void SLocalDirModelTest::testUrls()
+{
+    const STestDir dir;
+    QVERIFY(populate(dir));
+
+    SLocalDirModel model;
+    model.openUrl(QUrl::fromLocalFile(dir.path()));
+    QTRY_COMPARE(model.rowCount(), 3);
+
+    for (int row = 0; row < model.rowCount(); ++row) {
+        const QModelIndex index = model.index(row, 0);
+        QCOMPARE(model.urlForIndex(index), QUrl::fromLocalFile(dir.path(index.data().toString())));
+        QCOMPARE(model.indexForUrl(model.urlForIndex(index)), index);
+        QVERIFY(!model.parent(index).isValid());
+    }
+
+    // Neither the root nor what isn't listed or isn't below it has a row
+    QVERIFY(!model.indexForUrl(model.rootUrl()).isValid());
+    QVERIFY(!model.indexForUrl(QUrl::fromLocalFile(dir.path(QStringLiteral("file")))).isValid());
+    QVERIFY(!model.indexForUrl(QUrl::fromLocalFile(dir.path(QStringLiteral("a/sub")))).isValid());
+    QVERIFY(!model.indexForUrl(QUrl::fromLocalFile(QDir::rootPath())).isValid());
+    QVERIFY(!model.indexForUrl(QUrl(QStringLiteral("sftp://server/home"))).isValid());
+    QCOMPARE(model.urlForIndex(QModelIndex()), model.rootUrl());
+    QCOMPARE(model.itemForIndex(QModelIndex()).url(), model.rootUrl());
+
+    // Children of a listed directory
+    const QModelIndex a = model.indexForUrl(QUrl::fromLocalFile(dir.path(QStringLiteral("a"))));
+    model.fetchMore(a);
+    QTRY_COMPARE(model.rowCount(a), 1);
+    const QModelIndex sub = model.index(0, 0, a);
+    QCOMPARE(model.parent(sub), a);
+    QCOMPARE(model.urlForIndex(sub), QUrl::fromLocalFile(dir.path(QStringLiteral("a/sub"))));
+    QCOMPARE(model.indexForUrl(QUrl::fromLocalFile(dir.path(QStringLiteral("a/sub/")))), sub);
+}
+
+void SLocalDirModelTest::testData()
+{
+    const STestDir dir;
+    QVERIFY(populate(dir));
+
+    SLocalDirModel model;
+    model.openUrl(QUrl::fromLocalFile(dir.path()));
+    QTRY_COMPARE(model.rowCount(), 3);
+
+    const QModelIndex a = model.indexForUrl(QUrl::fromLocalFile(dir.path(QStringLiteral("a"))));
+    QCOMPARE(a.data(Qt::EditRole).toString(), QStringLiteral("a"));
+    QCOMPARE(model.flags(a), Qt::ItemIsEnabled | Qt::ItemIsSelectable);
+
+    // Never anything that makes the view wait for the disk
+    QCOMPARE(a.data(Qt::DecorationRole).userType(), qMetaTypeId<QIcon>());
+
+    // With the permissions the listing found, so it never stat()s
+    struct stat buff;
+    QCOMPARE(stat(QFile::encodeName(dir.path(QStringLiteral("a"))).constData(), &buff), 0);
+    const KFileItem item = a.data(KDirModel::FileItemRole).value<KFileItem>();
+    QVERIFY(item.isDir());
+    QCOMPARE(mode_t(item.permissions()), buff.st_mode & 07777);
+    QCOMPARE(item.mimetype(), QStringLiteral("inode/directory"));
+    QCOMPARE(item.url(), QUrl::fromLocalFile(dir.path(QStringLiteral("a"))));
+    QCOMPARE(model.itemForIndex(a).url(), item.url());
+}
+
+void SLocalDirModelTest::testExpandToUrl()
+{
+    const STestDir dir;
+    QVERIFY(populate(dir));
+
+    SLocalDirModel model;
+    QSignalSpy spy(&model, &SLocalDirModel::expand);
+    model.openUrl(QUrl::fromLocalFile(dir.path()));
+
+    // Lists every level on the way, parents first
+    model.expandToUrl(QUrl::fromLocalFile(dir.path(QStringLiteral("a/sub/deep"))));
+    QTRY_COMPARE(spy.count(), 3);
+    QStringList expanded;
+    for (const QList<QVariant> &arguments : qAsConst(spy)) {
+        expanded.append(model.urlForIndex(arguments.at(0).toModelIndex()).toLocalFile());
+    }
+    QCOMPARE(expanded, (QStringList{dir.path(QStringLiteral("a")), dir.path(QStringLiteral("a/sub")), dir.path(QStringLiteral("a/sub/deep"))}));
+
+    // Stops where something isn't there, after listing it once more
+    spy.clear();
+    model.expandToUrl(QUrl::fromLocalFile(dir.path(QStringLiteral("a/missing"))));
+    QTest::qWait(200);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(model.urlForIndex(spy.at(0).at(0).toModelIndex()), QUrl::fromLocalFile(dir.path(QStringLiteral("a"))));
+
+    // And doesn't start for what isn't below the root
+    spy.clear();
+    model.expandToUrl(QUrl::fromLocalFile(QDir::rootPath()));
+    QTest::qWait(200);
+    QVERIFY(spy.isEmpty());
+}
+
+void SLocalDirModelTest::testExpandToNewDirectory()
+{
+    const STestDir dir;
+    QVERIFY(populate(dir));
+
+    SLocalDirModel model;
+    QSignalSpy spy(&model, &SLocalDirModel::expand);
+    model.openUrl(QUrl::fromLocalFile(dir.path()));
+    QTRY_COMPARE(model.rowCount(), 3);
+
+    // Like "New Folder...", before the watcher had a chance to tell us
+    QVERIFY(dir.mkpath(QStringLiteral("new")));
+    model.expandToUrl(QUrl::fromLocalFile(dir.path(QStringLiteral("new"))));
+    QTRY_COMPARE(spy.count(), 1);
+    QCOMPARE(model.urlForIndex(spy.at(0).at(0).toModelIndex()), QUrl::fromLocalFile(dir.path(QStringLiteral("new"))));
+}
+
+void SLocalDirModelTest::testWatcher()
+{
+    const STestDir dir;
+    QVERIFY(populate(dir));
+
+    SLocalDirModel model;
+    model.openUrl(QUrl::fromLocalFile(dir.path()));
+    QTRY_COMPARE(model.rowCount(), 3);
+
+    QVERIFY(dir.mkpath(QStringLiteral("b")));
+    QTRY_COMPARE_WITH_TIMEOUT(rowNames(model), (QStringList{QStringLiteral(".hidden"), QStringLiteral("a"), QStringLiteral("b"), QStringLiteral("link")}), 5000);
+
+    // Files don't show up
+    QVERIFY(dir.touch(QStringLiteral("other")));
+
+    QVERIFY(dir.rmdir(QStringLiteral(".hidden")));
+    QTRY_COMPARE_WITH_TIMEOUT(rowNames(model), (QStringList{QStringLiteral("a"), QStringLiteral("b"), QStringLiteral("link")}), 5000);
+
+    // Below the root, too, once it's listed
+    const QModelIndex a = model.indexForUrl(QUrl::fromLocalFile(dir.path(QStringLiteral("a"))));
+    model.fetchMore(a);
+    QTRY_COMPARE(model.rowCount(a), 1);
+    QVERIFY(dir.mkpath(QStringLiteral("a/sub2")));
+    QTRY_COMPARE_WITH_TIMEOUT(rowNames(model, a), (QStringList{QStringLiteral("sub"), QStringLiteral("sub2")}), 5000);
+}
+
+void SLocalDirModelTest::testOpenUrlDropsOldListings()
+{
+    const STestDir dir;
+    QVERIFY(populate(dir));
+
+    SLocalDirModel model;
+    model.openUrl(QUrl::fromLocalFile(dir.path()));
+    model.openUrl(QUrl::fromLocalFile(dir.path(QStringLiteral("a"))));
+    QCOMPARE(model.rowCount(), 0);
+
+    QTRY_COMPARE(rowNames(model), QStringList{QStringLiteral("sub")});
+    QTest::qWait(200);
+    QCOMPARE(rowNames(model), QStringList{QStringLiteral("sub")});
+}
+
+QTEST_MAIN(SLocalDirModelTest)
+
+#include "slocaldirmodel_unittest.moc"
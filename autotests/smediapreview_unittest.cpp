@@ -0,0 +1,190 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "../src/platformtheme/smediapreview_p.h"
+
+#include <QTest>
+
+using SMediaPreviewParsers::Summary;
+
+namespace
+{
+
+QByteArray bigEndian32(quint32 value)
+{
+    QByteArray result(4, '\0');
+    result[0] = char(value >> 24);
+    result[1] = char(value >> 16);
+    result[2] = char(value >> 8);
+    result[3] = char(value);
+    return result;
+}
+
+QByteArray littleEndian32(quint32 value)
+{
+    QByteArray result(4, '\0');
+    result[0] = char(value);
+    result[1] = char(value >> 8);
+    result[2] = char(value >> 16);
+    result[3] = char(value >> 24);
+    return result;
+}
+
+QByteArray syncSafe32(quint32 value)
+{
+    QByteArray result(4, '\0');
+    result[0] = char((value >> 21) & 0x7f);
+    result[1] = char((value >> 14) & 0x7f);
+    result[2] = char((value >> 7) & 0x7f);
+    result[3] = char(value & 0x7f);
+    return result;
+}
+
+// An ID3v2.3 tag, the frames and extended header as given
+QByteArray id3v23(const QByteArray &extendedHeader, const QByteArray &frames)
+{
+    const QByteArray body = extendedHeader + frames;
+    QByteArray tag("ID3\x03\x00", 5);
+    tag += char(extendedHeader.isEmpty() ? 0 : 0x40);
+    tag += syncSafe32(body.size());
+    return tag + body;
+}
+
+QByteArray id3v23Frame(const QByteArray &id, const QByteArray &text, quint32 size)
+{
+    return id + bigEndian32(size) + QByteArray(2, '\0') + '\0' + text;
+}
+
+QByteArray id3v23Frame(const QByteArray &id, const QByteArray &text)
+{
+    return id3v23Frame(id, text, text.size() + 1);
+}
+
+QByteArray flacBlock(int type, const QByteArray &data, bool last = true)
+{
+    QByteArray block = bigEndian32(data.size() & 0xffffff);
+    block[0] = char(type | (last ? 0x80 : 0));
+    return block + data;
+}
+
+QByteArray vorbisComment(quint32 vendorLength, const QByteArray &vendor, const QList<QPair<quint32, QByteArray>> &comments)
+{
+    QByteArray data = littleEndian32(vendorLength) + vendor + littleEndian32(comments.count());
+    for (const auto &comment : comments) {
+        data += littleEndian32(comment.first) + comment.second;
+    }
+    return data;
+}
+
+QString valueOf(const Summary &summary, const QString &label)
+{
+    for (const auto &entry : summary) {
+        if (entry.first == label) {
+            return entry.second;
+        }
+    }
+    return QString();
+}
+
+}
+
+class SMediaPreviewTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testId3v2();
+    void testId3v2Malformed_data();
+    void testId3v2Malformed();
+    void testFlac();
+    void testFlacMalformed_data();
+    void testFlacMalformed();
+};
+
+void SMediaPreviewTest::testId3v2()
+{
+    const QByteArray tag = id3v23(bigEndian32(6) + QByteArray(6, '\0'), id3v23Frame("TIT2", "Title") + id3v23Frame("TPE1", "Artist"));
+
+    Summary summary;
+    SMediaPreviewParsers::readId3v2(tag, &summary);
+    QCOMPARE(summary.count(), 2);
+    QCOMPARE(valueOf(summary, QStringLiteral("Title:")), QStringLiteral("Title"));
+    QCOMPARE(valueOf(summary, QStringLiteral("Artist:")), QStringLiteral("Artist"));
+}
+
+void SMediaPreviewTest::testId3v2Malformed_data()
+{
+    QTest::addColumn<QByteArray>("head");
+
+    QTest::newRow("truncated header") << QByteArray("ID3\x03\x00\x40", 6);
+    QTest::newRow("truncated extended header") << id3v23(bigEndian32(6), QByteArray()).left(12);
+    QTest::newRow("huge extended header") << id3v23(bigEndian32(0xffffffff) + QByteArray(6, '\0'), id3v23Frame("TIT2", "Title"));
+    QTest::newRow("negative extended header") << id3v23(bigEndian32(0x80000000) + QByteArray(6, '\0'), id3v23Frame("TIT2", "Title"));
+    QTest::newRow("huge frame") << id3v23(QByteArray(), id3v23Frame("TIT2", "Title", 0xffffffff));
+    QTest::newRow("frame past the end") << id3v23(QByteArray(), id3v23Frame("TIT2", "Title", 100));
+    QTest::newRow("tag past the end") << id3v23(QByteArray(), id3v23Frame("TIT2", "Title")).left(16);
+
+    QByteArray v24("ID3\x04\x00\x40", 6);
+    v24 += syncSafe32(20) + syncSafe32(0x0fffffff) + QByteArray(16, '\0');
+    QTest::newRow("huge v2.4 extended header") << v24;
+}
+
+void SMediaPreviewTest::testId3v2Malformed()
+{
+    QFETCH(QByteArray, head);
+
+    // Must not read outside of head, nor come up with a title
+    Summary summary;
+    SMediaPreviewParsers::readId3v2(head, &summary);
+    QVERIFY(valueOf(summary, QStringLiteral("Title:")).isEmpty());
+}
+
+void SMediaPreviewTest::testFlac()
+{
+    QByteArray streamInfo(34, '\0');
+    // 44100 Hz, 44100 * 90 samples
+    streamInfo[10] = char(0x0a);
+    streamInfo[11] = char(0xc4);
+    streamInfo[12] = char(0x40);
+    streamInfo.replace(14, 4, bigEndian32(44100 * 90));
+
+    const QByteArray comments = vorbisComment(6, "vendor", {qMakePair(quint32(10), QByteArray("TITLE=Song")), qMakePair(quint32(8), QByteArray("ALBUM=Al"))});
+    const QByteArray head = QByteArray("fLaC") + flacBlock(0, streamInfo, false) + flacBlock(4, comments);
+
+    Summary summary;
+    SMediaPreviewParsers::readFlac(head, &summary);
+    QCOMPARE(valueOf(summary, QStringLiteral("Title:")), QStringLiteral("Song"));
+    QCOMPARE(valueOf(summary, QStringLiteral("Album:")), QStringLiteral("Al"));
+    QCOMPARE(valueOf(summary, QStringLiteral("Duration:")), QStringLiteral("1:30"));
+}
+
+void SMediaPreviewTest::testFlacMalformed_data()
+{
+    QTest::addColumn<QByteArray>("head");
+
+    const QByteArray title("TITLE=Song");
+
+    QTest::newRow("truncated block header") << QByteArray("fLaC\x84\x00", 6);
+    QTest::newRow("block past the end") << (QByteArray("fLaC") + flacBlock(4, vorbisComment(0, QByteArray(), {qMakePair(quint32(10), title)}))).left(20);
+    QTest::newRow("huge vendor") << QByteArray("fLaC") + flacBlock(4, vorbisComment(0xfffffff0, QByteArray(), {qMakePair(quint32(10), title)}));
+    QTest::newRow("negative vendor") << QByteArray("fLaC") + flacBlock(4, vorbisComment(0x80000000, QByteArray(), {qMakePair(quint32(10), title)}));
+    QTest::newRow("huge comment") << QByteArray("fLaC") + flacBlock(4, vorbisComment(0, QByteArray(), {qMakePair(quint32(0xffffffff), title)}));
+    QTest::newRow("wrapping comment") << QByteArray("fLaC") + flacBlock(4, vorbisComment(0, QByteArray(), {qMakePair(quint32(0xfffffffc), title)}));
+    QTest::newRow("comment past the end") << QByteArray("fLaC") + flacBlock(4, vorbisComment(0, QByteArray(), {qMakePair(quint32(11), title)}));
+}
+
+void SMediaPreviewTest::testFlacMalformed()
+{
+    QFETCH(QByteArray, head);
+
+    Summary summary;
+    SMediaPreviewParsers::readFlac(head, &summary);
+    QVERIFY(valueOf(summary, QStringLiteral("Title:")).isEmpty());
+}
+
+QTEST_GUILESS_MAIN(SMediaPreviewTest)
+
+#include "smediapreview_unittest.moc"
@@ -0,0 +1,143 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "../src/platformtheme/smountwatcher_p.h"
+
+#include <QTest>
+
+using SMountWatcherParsers::Entry;
+
+class SMountWatcherTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testParseMountInfo();
+    void testParseMalformed_data();
+    void testParseMalformed();
+    void testUnescapeOctal_data();
+    void testUnescapeOctal();
+    void testUnescapeHex_data();
+    void testUnescapeHex();
+    void testSystemMountPoints_data();
+    void testSystemMountPoints();
+};
+
+void SMountWatcherTest::testParseMountInfo()
+{
+    const QByteArray contents =
+        "22 1 259:2 / / rw,relatime shared:1 - ext4 /dev/nvme0n1p2 rw\n"
+        "48 22 8:17 / /run/media/user/My\\040Disk rw,nosuid,nodev shared:30 master:2 - vfat /dev/sdb1 rw,fmask=0022\n"
+        "51 22 0:50 / /mnt/share rw,relatime shared:32 - cifs //server/share\\134dir rw,vers=3.1.1\n";
+
+    const QVector<Entry> entries = SMountWatcherParsers::parseMountInfo(contents);
+    QCOMPARE(entries.count(), 3);
+
+    QCOMPARE(entries.at(0).majorMinor, QByteArray("259:2"));
+    QCOMPARE(entries.at(0).mountPoint, QStringLiteral("/"));
+    QCOMPARE(entries.at(0).fileSystemType, QStringLiteral("ext4"));
+    QCOMPARE(entries.at(0).source, QStringLiteral("/dev/nvme0n1p2"));
+
+    // Any number of optional fields before the separator
+    QCOMPARE(entries.at(1).majorMinor, QByteArray("8:17"));
+    QCOMPARE(entries.at(1).mountPoint, QStringLiteral("/run/media/user/My Disk"));
+    QCOMPARE(entries.at(1).fileSystemType, QStringLiteral("vfat"));
+    QCOMPARE(entries.at(1).source, QStringLiteral("/dev/sdb1"));
+
+    QCOMPARE(entries.at(2).fileSystemType, QStringLiteral("cifs"));
+    QCOMPARE(entries.at(2).source, QStringLiteral("//server/share\\dir"));
+    QVERIFY(SMountWatcherParsers::isNetworkFileSystem(entries.at(2).fileSystemType));
+    QVERIFY(!SMountWatcherParsers::isNetworkFileSystem(entries.at(1).fileSystemType));
+}
+
+void SMountWatcherTest::testParseMalformed_data()
+{
+    QTest::addColumn<QByteArray>("contents");
+
+    QTest::newRow("empty") << QByteArray();
+    QTest::newRow("blank lines") << QByteArray("\n\n");
+    QTest::newRow("no separator") << QByteArray("22 1 259:2 / / rw,relatime shared:1 ext4 /dev/nvme0n1p2 rw\n");
+    QTest::newRow("cut after separator") << QByteArray("22 1 259:2 / / rw,relatime -\n");
+    QTest::newRow("cut after type") << QByteArray("22 1 259:2 / / rw,relatime - ext4\n");
+    QTest::newRow("separator too early") << QByteArray("22 1 - ext4 /dev/sda1\n");
+}
+
+void SMountWatcherTest::testParseMalformed()
+{
+    QFETCH(QByteArray, contents);
+
+    QVERIFY(SMountWatcherParsers::parseMountInfo(contents).isEmpty());
+}
+
+void SMountWatcherTest::testUnescapeOctal_data()
+{
+    QTest::addColumn<QByteArray>("field");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("plain") << QByteArray("/mnt/data") << QStringLiteral("/mnt/data");
+    QTest::newRow("space") << QByteArray("/mnt/a\\040b") << QStringLiteral("/mnt/a b");
+    QTest::newRow("tab and newline") << QByteArray("a\\011b\\012c") << QStringLiteral("a\tb\nc");
+    QTest::newRow("backslash") << QByteArray("a\\134b") << QStringLiteral("a\\b");
+    QTest::newRow("at the end") << QByteArray("a\\040") << QStringLiteral("a ");
+    QTest::newRow("cut short") << QByteArray("a\\04") << QStringLiteral("a\\04");
+    QTest::newRow("not octal") << QByteArray("a\\xyz") << QStringLiteral("a\\xyz");
+    QTest::newRow("lone backslash") << QByteArray("\\") << QStringLiteral("\\");
+}
+
+void SMountWatcherTest::testUnescapeOctal()
+{
+    QFETCH(QByteArray, field);
+    QFETCH(QString, expected);
+
+    QCOMPARE(SMountWatcherParsers::unescapeOctal(field), expected);
+}
+
+void SMountWatcherTest::testUnescapeHex_data()
+{
+    QTest::addColumn<QString>("name");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("plain") << QStringLiteral("DATA") << QStringLiteral("DATA");
+    QTest::newRow("space") << QStringLiteral("My\\x20Disk") << QStringLiteral("My Disk");
+    QTest::newRow("utf-8") << QStringLiteral("Caf\\xc3\\xa9") << QString::fromUtf8("Caf\xc3\xa9");
+    QTest::newRow("cut short") << QStringLiteral("a\\x2") << QStringLiteral("a\\x2");
+    QTest::newRow("not hex escape") << QStringLiteral("a\\n") << QStringLiteral("a\\n");
+}
+
+void SMountWatcherTest::testUnescapeHex()
+{
+    QFETCH(QString, name);
+    QFETCH(QString, expected);
+
+    QCOMPARE(SMountWatcherParsers::unescapeHex(name), expected);
+}
+
+void SMountWatcherTest::testSystemMountPoints_data()
+{
+    QTest::addColumn<QString>("mountPoint");
+    QTest::addColumn<bool>("system");
+
+    QTest::newRow("root") << QStringLiteral("/") << false;
+    QTest::newRow("home") << QStringLiteral("/home") << false;
+    QTest::newRow("boot") << QStringLiteral("/boot") << true;
+    QTest::newRow("below boot") << QStringLiteral("/boot/efi") << true;
+    QTest::newRow("starts like boot") << QStringLiteral("/bootstrap") << false;
+    QTest::newRow("snap") << QStringLiteral("/snap/core/123") << true;
+    QTest::newRow("run") << QStringLiteral("/run/user/1000") << true;
+    QTest::newRow("run media") << QStringLiteral("/run/media/user/stick") << false;
+}
+
+void SMountWatcherTest::testSystemMountPoints()
+{
+    QFETCH(QString, mountPoint);
+    QFETCH(bool, system);
+
+    QCOMPARE(SMountWatcherParsers::isSystemMountPoint(mountPoint), system);
+}
+
+QTEST_GUILESS_MAIN(SMountWatcherTest)
+
+#include "smountwatcher_unittest.moc"
@@ -0,0 +1,76 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef STESTDIR_H
+#define STESTDIR_H
+
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+#include <QTemporaryDir>
+
+/**
+ * A temporary directory for the tests that watch or list directories,
+ * removed with everything in it when it goes out of scope.
+ *
+ * The helpers return false on failure, so they can go into QVERIFY().
+ */
+class STestDir
+{
+public:
+    // With @p directories (relative paths) created in it
+    explicit STestDir(const QStringList &directories = QStringList())
+    {
+        m_valid = m_dir.isValid();
+        for (const QString &directory : directories) {
+            m_valid = m_valid && mkpath(directory);
+        }
+    }
+
+    bool isValid() const
+    {
+        return m_valid;
+    }
+
+    QString path() const
+    {
+        return m_dir.path();
+    }
+
+    QString path(const QString &relativePath) const
+    {
+        return m_dir.path() + QLatin1Char('/') + relativePath;
+    }
+
+    // Creates @p relativePath and everything on the way there
+    bool mkpath(const QString &relativePath) const
+    {
+        return QDir(m_dir.path()).mkpath(relativePath);
+    }
+
+    bool rmdir(const QString &relativePath) const
+    {
+        return QDir(m_dir.path()).rmdir(relativePath);
+    }
+
+    // Creates an empty file
+    bool touch(const QString &relativePath) const
+    {
+        QFile file(path(relativePath));
+        return file.open(QIODevice::WriteOnly);
+    }
+
+    bool link(const QString &targetRelativePath, const QString &relativePath) const
+    {
+        return QFile::link(path(targetRelativePath), path(relativePath));
+    }
+
+private:
+    QTemporaryDir m_dir;
+    bool m_valid = false;
+};
+
+#endif
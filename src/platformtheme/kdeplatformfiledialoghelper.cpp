@@ -23,6 +23,7 @@
 #include "kdeplatformfiledialogbase_p.h"
 #include "kdirselectdialog_p.h"
 #include "previewprovider.h"
+#include "slocationcompletion.h"
 
 #include "sfilemetapreview.h"
 
@@ -129,6 +130,24 @@ KDEPlatformFileDialog::KDEPlatformFileDialog()
     connect(m_fileWidget->cancelButton(), &QAbstractButton::clicked, this, &QDialog::reject);
     connect(m_fileWidget->dirOperator(), &KDirOperator::urlEntered, this, &KDEPlatformFileDialogBase::directoryEntered);
     m_fileWidget->dirOperator()->setPreviewWidget(new SFileMetaPreview(this));
+
+    // Complete local paths from the in-memory directory index instead of
+    // listing the directory on every key press. The original completion
+    // object is kept alive in case KFileWidget still refers to it.
+    KUrlComboBox *locationEdit = m_fileWidget->locationEdit();
+    KCompletion *fileCompletion = locationEdit->completionObject();
+    locationEdit->setAutoDeleteCompletionObject(false);
+    fileCompletion->setParent(this);
+
+    SLocationCompletion *locationCompletion = new SLocationCompletion(this);
+    locationCompletion->setDir(m_fileWidget->baseUrl());
+    locationEdit->setCompletionObject(locationCompletion);
+    connect(m_fileWidget->dirOperator(), &KDirOperator::urlEntered, locationCompletion, &SLocationCompletion::setDir);
+    connect(locationCompletion, &KCompletion::match, this, [this, locationCompletion](const QString &match) {
+        if (!match.isEmpty() && !match.endsWith(QLatin1Char('/'))) {
+            m_fileWidget->dirOperator()->setCurrentItem(locationCompletion->urlForMatch(match));
+        }
+    });
     //m_fileWidget->dirOperator()->setPreviewWidget(new KImageFilePreview);
     layout()->addWidget(m_buttons);
 
@@ -20,16 +20,21 @@
 
 #include "kdirselectdialog_p.h"
 
+#include <QCoreApplication>
 #include <QDebug>
 #include <QDialogButtonBox>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QFileDialog>
 #include <QInputDialog>
 #include <QLayout>
 #include <QMenu>
+#include <QPointer>
 #include <QPushButton>
 #include <QStandardPaths>
 #include <QStringList>
+#include <QTimer>
 #include <QUrl>
 
 #include <kio/jobuidelegate.h>
@@ -64,6 +69,47 @@
 #include "sfileplacesmodel.h"
 // ### add mutator for treeview!
 
+namespace
+{
+
+// How long history and size changes are kept in memory before hitting the disk
+const int s_configSyncDelay = 10000;
+
+// How long we believe whether something is a directory, it might be created
+// or deleted by someone else any time
+const qint64 s_isDirMaxAge = 5000;
+
+// Our own small file, so closing the dialog doesn't rewrite the global config
+KSharedConfig::Ptr dirSelectConfig()
+{
+    // Kept alive so pending changes aren't synced by the destructor right away,
+    // it still syncs them on exit if nothing else did.
+    static KSharedConfig::Ptr s_config = KSharedConfig::openConfig(QStringLiteral("kdirselectdialogrc"), KConfig::SimpleConfig);
+    return s_config;
+}
+
+void scheduleConfigSync()
+{
+    static QPointer<QTimer> s_syncTimer;
+    if (!s_syncTimer) {
+        s_syncTimer = new QTimer(QCoreApplication::instance());
+        s_syncTimer->setSingleShot(true);
+        s_syncTimer->setInterval(s_configSyncDelay);
+        QObject::connect(s_syncTimer.data(), &QTimer::timeout, [] {
+            dirSelectConfig()->sync();
+        });
+        QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, [] {
+            dirSelectConfig()->sync();
+        });
+    }
+
+    if (!s_syncTimer->isActive()) {
+        s_syncTimer->start();
+    }
+}
+
+}
+
 class KDirSelectDialog::Private
 {
 public:
@@ -74,9 +120,11 @@ public:
     {
     }
 
-    void readConfig(const KSharedConfigPtr &config, const QString &group);
-    void saveConfig(KSharedConfigPtr config, const QString &group);
+    void readConfig(const QString &group);
+    void saveConfig(const QString &group);
     void slotMkdir();
+    void validateUrl(const QUrl &url);
+    void cancelValidation();
 
     void slotCurrentChanged();
     void slotExpand(const QModelIndex &);
@@ -103,13 +151,77 @@ public:
     QAction *moveToTrash = nullptr;
     QAction *deleteAction = nullptr;
     QAction *showHiddenFoldersAction = nullptr;
+
+    // Whether the urls entered in the combo are directories, so we never
+    // block while accepting. Forgotten when the dialog is shown again, and
+    // asked again on accept when older than s_isDirMaxAge.
+    struct IsDirEntry {
+        bool isDir;
+        QElapsedTimer age;
+    };
+    void cacheIsDir(const QUrl &url, bool isDir);
+    QHash<QUrl, IsDirEntry> m_isDirCache;
+    KIO::StatJob *m_validateJob = nullptr;
 };
 
-void KDirSelectDialog::Private::readConfig(const KSharedConfig::Ptr &config, const QString &group)
+void KDirSelectDialog::Private::cacheIsDir(const QUrl &url, bool isDir)
+{
+    IsDirEntry &entry = m_isDirCache[url];
+    entry.isDir = isDir;
+    entry.age.start();
+}
+
+void KDirSelectDialog::Private::validateUrl(const QUrl &url)
+{
+    if (m_validateJob) {
+        if (m_validateJob->url() == url) {
+            return;
+        }
+        m_validateJob->kill();
+    }
+
+    // Nothing else to click on while it's running, but Cancel still works
+    // and editing the combo gives up on it
+    m_validateJob = KIO::stat(url, KIO::HideProgressInfo);
+    m_validateJob->setDetails(KIO::StatBasic);
+    KJobWidgets::setWindow(m_validateJob, m_parent);
+    m_parent->m_buttons->button(QDialogButtonBox::Ok)->setEnabled(false);
+
+    QObject::connect(m_validateJob, &KJob::result, m_parent, [this, url](KJob *job) {
+        KIO::StatJob *statJob = static_cast<KIO::StatJob *>(job);
+        cacheIsDir(url, !statJob->error() && statJob->statResult().isDir());
+        m_validateJob = nullptr;
+        m_parent->m_buttons->button(QDialogButtonBox::Ok)->setEnabled(true);
+
+        // Try again, now that we know, unless that's not what the user
+        // wants anymore
+        if (m_parent->isVisible() && QUrl::fromUserInput(m_urlCombo->currentText()) == url) {
+            m_parent->accept();
+        }
+    });
+}
+
+void KDirSelectDialog::Private::cancelValidation()
+{
+    if (!m_validateJob) {
+        return;
+    }
+
+    // Quietly, so we don't accept after all
+    m_validateJob->kill();
+    m_validateJob = nullptr;
+    m_parent->m_buttons->button(QDialogButtonBox::Ok)->setEnabled(true);
+}
+
+void KDirSelectDialog::Private::readConfig(const QString &group)
 {
     m_urlCombo->clear();
 
-    KConfigGroup conf(config, group);
+    KConfigGroup conf(dirSelectConfig(), group);
+    if (!conf.exists()) {
+        // Written to the global config by older versions
+        conf = KConfigGroup(KSharedConfig::openConfig(), group);
+    }
     m_urlCombo->setHistoryItems(conf.readPathEntry("History Items", QStringList()));
 
     const QSize size = conf.readEntry("DirSelectDialog Size", QSize());
@@ -118,14 +230,16 @@ void KDirSelectDialog::Private::readConfig(const KSharedConfig::Ptr &config, con
     }
 }
 
-void KDirSelectDialog::Private::saveConfig(KSharedConfig::Ptr config, const QString &group)
+void KDirSelectDialog::Private::saveConfig(const QString &group)
 {
-    KConfigGroup conf(config, group);
-    KConfigGroup::WriteConfigFlags flags(KConfigGroup::Persistent | KConfigGroup::Global);
-    conf.writePathEntry("History Items", m_urlCombo->historyItems(), flags);
-    conf.writeEntry("DirSelectDialog Size", m_parent->size(), flags);
+    // Unchanged values don't mark the config dirty, so this is usually a no-op
+    KConfigGroup conf(dirSelectConfig(), group);
+    conf.writePathEntry("History Items", m_urlCombo->historyItems());
+    conf.writeEntry("DirSelectDialog Size", m_parent->size());
 
-    config->sync();
+    if (dirSelectConfig()->isDirty()) {
+        scheduleConfigSync();
+    }
 }
 
 void KDirSelectDialog::Private::slotMkdir()
@@ -180,6 +294,8 @@ void KDirSelectDialog::Private::slotMkdir()
         return;
     }
 
+    m_isDirCache.clear();
+
     // Select the newly created dir
     m_parent->setCurrentUrl(folderurl);
 }
@@ -222,6 +338,8 @@ void KDirSelectDialog::Private::slotUrlActivated(const QString &text)
 
 void KDirSelectDialog::Private::slotComboTextChanged(const QString &text)
 {
+    cancelValidation();
+
     m_treeView->blockSignals(true);
     QUrl url = QUrl::fromUserInput(text);
 #ifdef Q_OS_WIN
@@ -259,6 +377,7 @@ void KDirSelectDialog::Private::slotMoveToTrash()
     const QUrl url = m_treeView->selectedUrl();
     KIO::JobUiDelegate job;
     if (job.askDeleteConfirmation(QList<QUrl>() << url, KIO::JobUiDelegate::Trash, KIO::JobUiDelegate::DefaultConfirmation)) {
+        m_isDirCache.clear();
         KIO::CopyJob *copyJob = KIO::trash(url);
         KJobWidgets::setWindow(copyJob, m_parent);
         copyJob->uiDelegate()->setAutoErrorHandlingEnabled(true);
@@ -270,6 +389,7 @@ void KDirSelectDialog::Private::slotDelete()
     const QUrl url = m_treeView->selectedUrl();
     KIO::JobUiDelegate job;
     if (job.askDeleteConfirmation(QList<QUrl>() << url, KIO::JobUiDelegate::Delete, KIO::JobUiDelegate::DefaultConfirmation)) {
+        m_isDirCache.clear();
         KIO::DeleteJob *deleteJob = KIO::del(url);
         KJobWidgets::setWindow(deleteJob, m_parent);
         deleteJob->uiDelegate()->setAutoErrorHandlingEnabled(true);
@@ -401,7 +521,7 @@ KDirSelectDialog::KDirSelectDialog(const QUrl &startDir, bool localOnly, QWidget
     d->m_startDir = d->m_startURL;
     d->m_rootUrl = d->m_treeView->rootUrl();
 
-    d->readConfig(KSharedConfig::openConfig(), QStringLiteral("DirSelect Dialog"));
+    d->readConfig(QStringLiteral("DirSelect Dialog"));
 
     mainLayout->addWidget(d->m_treeView, 1);
     mainLayout->addWidget(d->m_urlCombo, 0);
@@ -425,6 +545,9 @@ KDirSelectDialog::KDirSelectDialog(const QUrl &startDir, bool localOnly, QWidget
 
 KDirSelectDialog::~KDirSelectDialog()
 {
+    if (d->m_validateJob) {
+        d->m_validateJob->kill();
+    }
     delete d;
 }
 
@@ -433,10 +556,20 @@ QUrl KDirSelectDialog::url() const
     QUrl comboUrl = QUrl::fromUserInput(d->m_urlCombo->currentText());
 
     if (comboUrl.isValid()) {
-        KIO::StatJob *statJob = KIO::stat(comboUrl, KIO::HideProgressInfo);
-        KJobWidgets::setWindow(statJob, d->m_parent);
-        const bool ok = statJob->exec();
-        if (ok && statJob->statResult().isDir()) {
+        const auto cached = d->m_isDirCache.constFind(comboUrl);
+        bool isDir;
+        if (cached != d->m_isDirCache.constEnd()) {
+            isDir = cached->isDir;
+        } else {
+            // Not validated by accept() yet, we have to block
+            KIO::StatJob *statJob = KIO::stat(comboUrl, KIO::HideProgressInfo);
+            KJobWidgets::setWindow(statJob, d->m_parent);
+            const bool ok = statJob->exec();
+            isDir = ok && statJob->statResult().isDir();
+            d->cacheIsDir(comboUrl, isDir);
+        }
+
+        if (isDir) {
             return comboUrl;
         }
     }
@@ -500,6 +633,17 @@ void KDirSelectDialog::setCurrentUrl(const QUrl &url)
 
 void KDirSelectDialog::accept()
 {
+    // Find out whether what's in the combo is a directory without blocking,
+    // we get back here when the stat job is done.
+    const QUrl comboUrl = QUrl::fromUserInput(d->m_urlCombo->currentText());
+    if (comboUrl.isValid()) {
+        const auto cached = d->m_isDirCache.constFind(comboUrl);
+        if (cached == d->m_isDirCache.constEnd() || cached->age.hasExpired(s_isDirMaxAge)) {
+            d->validateUrl(comboUrl);
+            return;
+        }
+    }
+
     QUrl selectedUrl = url();
     if (!selectedUrl.isValid()) {
         return;
@@ -510,14 +654,35 @@ void KDirSelectDialog::accept()
     }
 
     d->m_urlCombo->addToHistory(selectedUrl.toDisplayString());
-    KFileWidget::setStartDir(url());
+    KFileWidget::setStartDir(selectedUrl);
 
     QDialog::accept();
 }
 
+void KDirSelectDialog::reject()
+{
+    d->cancelValidation();
+
+    QDialog::reject();
+}
+
+void KDirSelectDialog::showEvent(QShowEvent *event)
+{
+    // Folders might have come and gone since we were last shown
+    d->m_isDirCache.clear();
+
+    QDialog::showEvent(event);
+}
+
 void KDirSelectDialog::hideEvent(QHideEvent *event)
 {
-    d->saveConfig(KSharedConfig::openConfig(), QStringLiteral("DirSelect Dialog"));
+    d->cancelValidation();
+    d->saveConfig(QStringLiteral("DirSelect Dialog"));
+
+    // The dialog is usually kept around, don't leave the places unsaved
+    if (SFilePlacesModel *placesModel = qobject_cast<SFilePlacesModel *>(d->m_placesView->model())) {
+        placesModel->flush();
+    }
 
     QDialog::hideEvent(event);
 }
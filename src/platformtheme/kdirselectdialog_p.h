@@ -116,6 +116,9 @@ public Q_SLOTS:
 
 protected:
     void accept() override;
+    void reject() override;
+
+    void showEvent(QShowEvent *event) override;
 
     /**
      * Reimplemented for saving the dialog geometry.
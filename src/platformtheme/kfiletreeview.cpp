@@ -20,10 +20,14 @@
 */
 
 #include "kfiletreeview_p.h"
+#include "slocaldirmodel.h"
 
+#include <QCollator>
 #include <QDir>
 #include <QContextMenuEvent>
 #include <QMenu>
+#include <QScrollBar>
+#include <QTimer>
 #include <QUrl>
 
 #include <kdirlister.h>
@@ -33,6 +37,67 @@
 #include <klocalizedstring.h>
 #include <ktoggleaction.h>
 
+namespace
+{
+
+// KDirSortFilterProxyModel assumes a KDirModel when sorting, so do that
+// ourselves for the local model.
+//
+// Hidden folders are always listed and only filtered out here, so toggling
+// them doesn't have to relist anything.
+class KFileTreeProxyModel : public KDirSortFilterProxyModel
+{
+public:
+    explicit KFileTreeProxyModel(QObject *parent)
+        : KDirSortFilterProxyModel(parent)
+    {
+        m_collator.setNumericMode(true);
+        m_collator.setCaseSensitivity(Qt::CaseInsensitive);
+    }
+
+    bool showHiddenFiles() const
+    {
+        return m_showHiddenFiles;
+    }
+
+    void setShowHiddenFiles(bool show)
+    {
+        if (m_showHiddenFiles == show) {
+            return;
+        }
+        m_showHiddenFiles = show;
+        invalidateFilter();
+    }
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const override
+    {
+        if (!m_showHiddenFiles) {
+            const QString name = sourceModel()->index(sourceRow, 0, sourceParent).data().toString();
+            if (name.startsWith(QLatin1Char('.'))) {
+                return false;
+            }
+        }
+        return KDirSortFilterProxyModel::filterAcceptsRow(sourceRow, sourceParent);
+    }
+
+    bool subSortLessThan(const QModelIndex &left, const QModelIndex &right) const override
+    {
+        if (qobject_cast<KDirModel *>(sourceModel())) {
+            return KDirSortFilterProxyModel::subSortLessThan(left, right);
+        }
+
+        // Only directories in there, so the names are all there is to it
+        return m_collator.compare(left.data().toString(), right.data().toString()) < 0;
+    }
+
+private:
+    QCollator m_collator;
+    bool m_showHiddenFiles = false;
+};
+
+}
+
 class KFileTreeView::Private
 {
 public:
@@ -42,18 +107,111 @@ public:
     }
 
     QUrl urlForProxyIndex(const QModelIndex &index) const;
+    void ensureRootListed();
+    void openRoot(KDirLister::OpenUrlFlags flags);
+    bool isLocal() const;
+    void schedulePrefetch();
+    void setSourceExpanded(const QModelIndex &index, bool expanded);
 
     void _k_activated(const QModelIndex &);
     void _k_currentChanged(const QModelIndex &, const QModelIndex &);
     void _k_expanded(const QModelIndex &);
+    void _k_prefetchVisible();
 
     KFileTreeView *const q;
     KDirModel *mSourceModel = nullptr;
-    KDirSortFilterProxyModel *mProxyModel = nullptr;
+    KFileTreeProxyModel *mProxyModel = nullptr;
+
+    // Used instead of mSourceModel for local directories in dir-only mode
+    SLocalDirModel *mLocalModel = nullptr;
+    bool mDirOnly = false;
+
+    // The root is only listed once we know what to show, so we don't list
+    // "/" just to throw it away when the dialog moves somewhere else.
+    QUrl mRootUrl;
+    bool mRootListed = false;
+
+    // Restarted on every scroll, so we only look at where the user stops
+    QTimer *mPrefetchTimer = nullptr;
 };
 
+void KFileTreeView::Private::ensureRootListed()
+{
+    if (mRootListed) {
+        return;
+    }
+
+    mRootListed = true;
+    openRoot(KDirLister::Keep);
+}
+
+void KFileTreeView::Private::openRoot(KDirLister::OpenUrlFlags flags)
+{
+    if (!mDirOnly || !mRootUrl.isLocalFile()) {
+        if (mProxyModel->sourceModel() != mSourceModel) {
+            mProxyModel->setSourceModel(mSourceModel);
+        }
+        mSourceModel->dirLister()->openUrl(mRootUrl, flags);
+        return;
+    }
+
+    if (!mLocalModel) {
+        mLocalModel = new SLocalDirModel(q);
+        QObject::connect(mLocalModel, SIGNAL(expand(QModelIndex)),
+                         q, SLOT(_k_expanded(QModelIndex)));
+    }
+    if (mProxyModel->sourceModel() != mLocalModel) {
+        mProxyModel->setSourceModel(mLocalModel);
+    }
+    mLocalModel->openUrl(mRootUrl);
+}
+
+bool KFileTreeView::Private::isLocal() const
+{
+    return mLocalModel && mProxyModel->sourceModel() == mLocalModel;
+}
+
+void KFileTreeView::Private::schedulePrefetch()
+{
+    if (isLocal()) {
+        mPrefetchTimer->start();
+    }
+}
+
+void KFileTreeView::Private::setSourceExpanded(const QModelIndex &index, bool expanded)
+{
+    // Tells the local model what it has to keep watching
+    if (isLocal()) {
+        mLocalModel->setExpanded(mProxyModel->mapToSource(index), expanded);
+    }
+}
+
+void KFileTreeView::Private::_k_prefetchVisible()
+{
+    if (!isLocal() || !q->isVisible()) {
+        return;
+    }
+
+    QModelIndexList indexes;
+    const QRect viewportRect = q->viewport()->rect();
+    for (QModelIndex index = q->indexAt(viewportRect.topLeft()); index.isValid(); index = q->indexBelow(index)) {
+        if (q->visualRect(index).top() > viewportRect.bottom()) {
+            break;
+        }
+        if (!q->isExpanded(index)) {
+            indexes.append(mProxyModel->mapToSource(index));
+        }
+    }
+
+    mLocalModel->prefetch(indexes);
+}
+
 QUrl KFileTreeView::Private::urlForProxyIndex(const QModelIndex &index) const
 {
+    if (isLocal()) {
+        return mLocalModel->urlForIndex(mProxyModel->mapToSource(index));
+    }
+
     const KFileItem item = mSourceModel->itemForIndex(mProxyModel->mapToSource(index));
 
     return !item.isNull() ? item.url() : QUrl();
@@ -89,14 +247,19 @@ KFileTreeView::KFileTreeView(QWidget *parent)
     : QTreeView(parent), d(new Private(this))
 {
     d->mSourceModel = new KDirModel(this);
-    d->mProxyModel = new KDirSortFilterProxyModel(this);
+    d->mProxyModel = new KFileTreeProxyModel(this);
     d->mProxyModel->setSourceModel(d->mSourceModel);
 
     setModel(d->mProxyModel);
     setItemDelegate(new KFileItemDelegate(this));
     setLayoutDirection(Qt::LeftToRight);
 
-    d->mSourceModel->dirLister()->openUrl(QUrl::fromLocalFile(QDir::root().absolutePath()), KDirLister::Keep);
+    // Only the ancestors of the current url are listed (by expandToUrl()),
+    // everything else is listed when expanded. Mimetypes are only needed
+    // for the icons of the rows actually shown.
+    d->mSourceModel->dirLister()->setDelayedMimeTypes(true);
+    d->mSourceModel->dirLister()->setShowingDotFiles(true);
+    d->mRootUrl = QUrl::fromLocalFile(QDir::root().absolutePath());
 
     connect(this, SIGNAL(activated(QModelIndex)),
             this, SLOT(_k_activated(QModelIndex)));
@@ -105,6 +268,37 @@ KFileTreeView::KFileTreeView(QWidget *parent)
 
     connect(d->mSourceModel, SIGNAL(expand(QModelIndex)),
             this, SLOT(_k_expanded(QModelIndex)));
+
+    // Find out which of the visible folders have subfolders before anyone
+    // clicks on them. Only done for the local model, it's cheap there.
+    d->mPrefetchTimer = new QTimer(this);
+    d->mPrefetchTimer->setSingleShot(true);
+    d->mPrefetchTimer->setInterval(100);
+    connect(d->mPrefetchTimer, SIGNAL(timeout()),
+            this, SLOT(_k_prefetchVisible()));
+
+    auto schedulePrefetch = [this]() {
+        d->schedulePrefetch();
+    };
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, schedulePrefetch);
+    connect(this, &QTreeView::expanded, this, [this](const QModelIndex &index) {
+        d->setSourceExpanded(index, true);
+        d->schedulePrefetch();
+    });
+    connect(this, &QTreeView::collapsed, this, [this](const QModelIndex &index) {
+        d->setSourceExpanded(index, false);
+        d->schedulePrefetch();
+    });
+    // Prefetching inserts rows below collapsed folders, those don't count
+    auto rowsChanged = [this](const QModelIndex &parent) {
+        if (!parent.isValid() || isExpanded(parent)) {
+            d->schedulePrefetch();
+        }
+    };
+    connect(d->mProxyModel, &QAbstractItemModel::rowsInserted, this, rowsChanged);
+    connect(d->mProxyModel, &QAbstractItemModel::rowsRemoved, this, rowsChanged);
+    connect(d->mProxyModel, &QAbstractItemModel::layoutChanged, this, schedulePrefetch);
+    connect(d->mProxyModel, &QAbstractItemModel::modelReset, this, schedulePrefetch);
 }
 
 KFileTreeView::~KFileTreeView()
@@ -150,25 +344,47 @@ QList<QUrl> KFileTreeView::selectedUrls() const
 
 QUrl KFileTreeView::rootUrl() const
 {
+    if (!d->mRootListed) {
+        return d->mRootUrl;
+    }
+    if (d->isLocal()) {
+        return d->mLocalModel->rootUrl();
+    }
     return d->mSourceModel->dirLister()->url();
 }
 
 void KFileTreeView::setDirOnlyMode(bool enabled)
 {
+    d->mDirOnly = enabled;
     d->mSourceModel->dirLister()->setDirOnlyMode(enabled);
-    d->mSourceModel->dirLister()->openUrl(d->mSourceModel->dirLister()->url());
+    if (d->mRootListed) {
+        d->openRoot(KDirLister::NoFlags);
+    }
 }
 
 void KFileTreeView::setShowHiddenFiles(bool enabled)
 {
-    QUrl url = currentUrl();
-    d->mSourceModel->dirLister()->setShowingDotFiles(enabled);
-    d->mSourceModel->dirLister()->openUrl(d->mSourceModel->dirLister()->url());
-    setCurrentUrl(url);
+    d->mProxyModel->setShowHiddenFiles(enabled);
 }
 
 void KFileTreeView::setCurrentUrl(const QUrl &url)
 {
+    d->ensureRootListed();
+
+    if (d->isLocal()) {
+        const QModelIndex baseIndex = d->mLocalModel->indexForUrl(url);
+        if (!baseIndex.isValid()) {
+            d->mLocalModel->expandToUrl(url);
+            return;
+        }
+
+        const QModelIndex proxyIndex = d->mProxyModel->mapFromSource(baseIndex);
+        selectionModel()->clearSelection();
+        selectionModel()->setCurrentIndex(proxyIndex, QItemSelectionModel::SelectCurrent);
+        scrollTo(proxyIndex);
+        return;
+    }
+
     QModelIndex baseIndex = d->mSourceModel->indexForUrl(url);
 
     if (!baseIndex.isValid()) {
@@ -184,14 +400,17 @@ void KFileTreeView::setCurrentUrl(const QUrl &url)
 
 void KFileTreeView::setRootUrl(const QUrl &url)
 {
-    d->mSourceModel->dirLister()->openUrl(url);
+    d->mRootUrl = url;
+    if (d->mRootListed) {
+        d->openRoot(KDirLister::NoFlags);
+    }
 }
 
 void KFileTreeView::contextMenuEvent(QContextMenuEvent *event)
 {
     QMenu menu;
     KToggleAction *showHiddenAction = new KToggleAction(i18n("Show Hidden Folders"), &menu);
-    showHiddenAction->setChecked(d->mSourceModel->dirLister()->showingDotFiles());
+    showHiddenAction->setChecked(showHiddenFiles());
     connect(showHiddenAction, &QAction::toggled, this, &KFileTreeView::setShowHiddenFiles);
 
     menu.addAction(showHiddenAction);
@@ -200,7 +419,22 @@ void KFileTreeView::contextMenuEvent(QContextMenuEvent *event)
 
 bool KFileTreeView::showHiddenFiles() const
 {
-    return d->mSourceModel->dirLister()->showingDotFiles();
+    return d->mProxyModel->showHiddenFiles();
+}
+
+void KFileTreeView::showEvent(QShowEvent *event)
+{
+    // Nobody told us where to go, show the root
+    d->ensureRootListed();
+
+    QTreeView::showEvent(event);
+    d->schedulePrefetch();
+}
+
+void KFileTreeView::resizeEvent(QResizeEvent *event)
+{
+    QTreeView::resizeEvent(event);
+    d->schedulePrefetch();
 }
 
 QSize KFileTreeView::sizeHint() const
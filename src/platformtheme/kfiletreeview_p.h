@@ -97,7 +97,8 @@ public Q_SLOTS:
     /**
      * Sets the root @p url of the view.
      *
-     * The default is file:///.
+     * The default is file:///. Nothing is listed until the view is shown
+     * or setCurrentUrl() is called.
      */
     void setRootUrl(const QUrl &url);
 
@@ -115,6 +116,8 @@ Q_SIGNALS:
 protected:
     using QTreeView::currentChanged;
     void contextMenuEvent(QContextMenuEvent *) override;
+    void showEvent(QShowEvent *) override;
+    void resizeEvent(QResizeEvent *) override;
 
 private:
     class Private;
@@ -123,6 +126,7 @@ private:
     Q_PRIVATE_SLOT(d, void _k_activated(const QModelIndex &))
     Q_PRIVATE_SLOT(d, void _k_currentChanged(const QModelIndex &, const QModelIndex &))
     Q_PRIVATE_SLOT(d, void _k_expanded(const QModelIndex &))
+    Q_PRIVATE_SLOT(d, void _k_prefetchVisible())
 };
 
 #endif
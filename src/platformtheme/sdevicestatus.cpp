@@ -0,0 +1,211 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "sdevicestatus.h"
+#include "smountwatcher.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QPointer>
+
+#include <sys/statvfs.h>
+
+#include <thread>
+
+namespace
+{
+
+// How long a mount gets to answer before it counts as not ready
+const int s_probeTimeout = 3000;
+
+// How old an answer can get before it's asked again, doubled for every
+// failure in a row up to s_maxBackoff times
+const qint64 s_maxAge = 60 * 1000;
+const int s_maxBackoff = 4;
+
+// Mounts nobody asked about for this long aren't refreshed anymore
+const qint64 s_idleTime = 5 * 60 * 1000;
+
+}
+
+SDeviceStatus *SDeviceStatus::self()
+{
+    static QPointer<SDeviceStatus> s_self;
+    if (!s_self) {
+        s_self = new SDeviceStatus(QCoreApplication::instance());
+    }
+    return s_self;
+}
+
+SDeviceStatus::SDeviceStatus(QObject *parent)
+    : QObject(parent)
+{
+    // A view painting its rows asks for one mount after the other
+    m_batchTimer.setSingleShot(true);
+    m_batchTimer.setInterval(100);
+    connect(&m_batchTimer, &QTimer::timeout, this, &SDeviceStatus::startPending);
+
+    m_refreshTimer.setInterval(s_maxAge / 2);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &SDeviceStatus::scheduleDue);
+
+    // Something else might be mounted where we looked before
+    connect(SMountWatcher::self(), &SMountWatcher::mountsChanged, this, [this]() {
+        for (Entry &entry : m_entries) {
+            entry.age.invalidate();
+            entry.failures = 0;
+        }
+        scheduleDue();
+    });
+}
+
+SDeviceStatus::Status SDeviceStatus::status(const QString &mountPoint)
+{
+    Entry &entry = m_entries[mountPoint];
+    entry.asked.start();
+    if (isDue(entry)) {
+        refresh(mountPoint);
+    }
+    return entry.status;
+}
+
+void SDeviceStatus::refresh(const QString &mountPoint)
+{
+    if (m_entries.value(mountPoint).probing) {
+        // Also when it's hanging; piling up more threads blocked on the same
+        // mount won't make it answer sooner
+        return;
+    }
+
+    m_pending.insert(mountPoint);
+    if (!m_batchTimer.isActive()) {
+        m_batchTimer.start();
+    }
+}
+
+bool SDeviceStatus::isDue(const Entry &entry)
+{
+    if (entry.probing) {
+        return false;
+    }
+    if (!entry.age.isValid()) {
+        return true;
+    }
+    return entry.age.hasExpired(s_maxAge << qMin(entry.failures, s_maxBackoff));
+}
+
+void SDeviceStatus::scheduleDue()
+{
+    bool idle = true;
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        if (!it->asked.isValid() || it->asked.hasExpired(s_idleTime)) {
+            continue;
+        }
+        idle = false;
+        if (isDue(*it)) {
+            refresh(it.key());
+        }
+    }
+
+    if (idle) {
+        m_refreshTimer.stop();
+    }
+}
+
+void SDeviceStatus::startPending()
+{
+    const QSet<QString> pending = m_pending;
+    m_pending.clear();
+    for (const QString &mountPoint : pending) {
+        startProbe(mountPoint);
+    }
+
+    if (!m_refreshTimer.isActive()) {
+        m_refreshTimer.start();
+    }
+}
+
+void SDeviceStatus::startProbe(const QString &mountPoint)
+{
+    Entry &entry = m_entries[mountPoint];
+    if (entry.probing) {
+        return;
+    }
+    entry.probing = true;
+    entry.generation = ++m_nextGeneration;
+    const quint64 generation = entry.generation;
+
+    QTimer::singleShot(s_probeTimeout, this, [this, mountPoint, generation]() {
+        probeTimedOut(mountPoint, generation);
+    });
+
+    // Detached, so a probe stuck in the kernel can't hold up quitting. The
+    // receiver lives until the answer is in, which might be never.
+    QObject *receiver = new QObject;
+    QPointer<SDeviceStatus> guard(this);
+    const QByteArray path = QFile::encodeName(mountPoint);
+    std::thread([receiver, guard, path, mountPoint, generation]() {
+        struct statvfs buf;
+        const bool ok = statvfs(path.constData(), &buf) == 0;
+        const quint64 size = ok ? quint64(buf.f_blocks) * buf.f_frsize : 0;
+        const quint64 available = ok ? quint64(buf.f_bavail) * buf.f_frsize : 0;
+
+        QMetaObject::invokeMethod(
+            receiver,
+            [receiver, guard, mountPoint, generation, ok, size, available]() {
+                if (guard) {
+                    guard->probeFinished(mountPoint, generation, ok, size, available);
+                }
+                receiver->deleteLater();
+            },
+            Qt::QueuedConnection);
+    }).detach();
+}
+
+void SDeviceStatus::probeFinished(const QString &mountPoint, quint64 generation, bool ok, quint64 size, quint64 available)
+{
+    const auto it = m_entries.find(mountPoint);
+    if (it == m_entries.end() || it->generation != generation) {
+        return;
+    }
+
+    Entry &entry = *it;
+    entry.probing = false;
+    entry.age.start();
+    entry.failures = ok ? 0 : entry.failures + 1;
+
+    const Status previous = entry.status;
+    entry.status.known = true;
+    entry.status.ready = ok;
+    entry.status.size = size;
+    entry.status.available = available;
+
+    if (!previous.known || previous.ready != ok || previous.size != size || previous.available != available) {
+        Q_EMIT statusChanged(mountPoint);
+    }
+}
+
+void SDeviceStatus::probeTimedOut(const QString &mountPoint, quint64 generation)
+{
+    const auto it = m_entries.find(mountPoint);
+    if (it == m_entries.end() || it->generation != generation || !it->probing) {
+        return;
+    }
+
+    // Keep the probe running, it reports when the mount comes back
+    Entry &entry = *it;
+    entry.failures++;
+
+    const bool wasReady = entry.status.ready;
+    const bool wasKnown = entry.status.known;
+    entry.status.known = true;
+    entry.status.ready = false;
+
+    if (!wasKnown || wasReady) {
+        Q_EMIT statusChanged(mountPoint);
+    }
+}
+
+#include "moc_sdevicestatus.cpp"
@@ -0,0 +1,91 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef SDEVICESTATUS_H
+#define SDEVICESTATUS_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+
+/**
+ * Whether mounted filesystems respond, and how full they are.
+ *
+ * statfs() on a dead network mount doesn't return, so it's never called on
+ * the GUI thread. Every mount point gets at most one probe at a time on a
+ * thread of its own, and the answer is cached. A probe that takes longer
+ * than the timeout marks the mount as not ready, until it does come back.
+ *
+ * Probes are started by one scheduler: requests are collected for a moment
+ * and started together, mounts that are still being asked about are
+ * refreshed every minute, and mounts that fail or time out are asked less
+ * and less often.
+ *
+ * There's one instance per process, shared by all places models and views.
+ */
+class SDeviceStatus : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Status {
+        // False until the first probe came back or timed out
+        bool known = false;
+        bool ready = false;
+        quint64 size = 0;
+        quint64 available = 0;
+    };
+
+    static SDeviceStatus *self();
+
+    /**
+     * Returns what's known about @p mountPoint, and schedules a probe if
+     * that's nothing or it's getting old.
+     */
+    Status status(const QString &mountPoint);
+
+    /**
+     * Schedules a probe of @p mountPoint, unless one is running already.
+     */
+    void refresh(const QString &mountPoint);
+
+Q_SIGNALS:
+    /**
+     * Emitted when the readiness or the free space of @p mountPoint changed.
+     */
+    void statusChanged(const QString &mountPoint);
+
+private:
+    explicit SDeviceStatus(QObject *parent);
+
+    struct Entry {
+        Status status;
+        // Since the last answer, invalid if there was none
+        QElapsedTimer age;
+        // Since someone last wanted to know, to stop refreshing idle mounts
+        QElapsedTimer asked;
+        int failures = 0;
+        bool probing = false;
+        quint64 generation = 0;
+    };
+
+    static bool isDue(const Entry &entry);
+    void scheduleDue();
+    void startPending();
+    void startProbe(const QString &mountPoint);
+    void probeFinished(const QString &mountPoint, quint64 generation, bool ok, quint64 size, quint64 available);
+    void probeTimedOut(const QString &mountPoint, quint64 generation);
+
+    QHash<QString, Entry> m_entries;
+    QSet<QString> m_pending;
+    QTimer m_batchTimer;
+    QTimer m_refreshTimer;
+    quint64 m_nextGeneration = 0;
+};
+
+#endif
@@ -0,0 +1,392 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "sdirwatcher.h"
+
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QRunnable>
+#include <QSocketNotifier>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+// We only care about entries coming and going, and the directory itself
+// going away. Content changes of files are none of our business.
+const uint32_t s_watchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                           | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+}
+
+class SDirWatcher::StatJob : public QRunnable
+{
+public:
+    StatJob(SDirWatcher *watcher, const QVector<Change> &changes)
+        : m_watcher(watcher)
+        , m_generation(watcher->m_generation)
+        , m_changes(changes)
+        , m_cancelled(watcher->m_cancelled)
+    {
+    }
+
+    void run() override
+    {
+        for (Change &change : m_changes) {
+            if (*m_cancelled) {
+                return;
+            }
+            if (change.unknown.isEmpty()) {
+                continue;
+            }
+
+            const int dirFd = open(QFile::encodeName(change.path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dirFd < 0) {
+                // The directory itself is gone, we get an IN_IGNORED for it
+                change.unknown.clear();
+                continue;
+            }
+
+            // Whatever happened in between, what's there now is what counts.
+            // This also catches symlinks to directories, which come without
+            // IN_ISDIR.
+            for (const QString &name : qAsConst(change.unknown)) {
+                struct stat buff;
+                if (fstatat(dirFd, QFile::encodeName(name).constData(), &buff, 0) == 0 && S_ISDIR(buff.st_mode)) {
+                    change.added.append(name);
+                } else {
+                    change.removed.append(name);
+                }
+            }
+            change.unknown.clear();
+            close(dirFd);
+        }
+
+        // The watcher waits for us before going away
+        SDirWatcher *watcher = m_watcher;
+        const quint64 generation = m_generation;
+        const QVector<Change> changes = m_changes;
+        QMetaObject::invokeMethod(watcher, [watcher, generation, changes]() {
+            watcher->changesChecked(generation, changes);
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    SDirWatcher *const m_watcher;
+    const quint64 m_generation;
+    QVector<Change> m_changes;
+    const std::shared_ptr<std::atomic<bool>> m_cancelled;
+};
+
+SDirWatcher::SDirWatcher(QObject *parent)
+    : QObject(parent)
+    , m_cancelled(std::make_shared<std::atomic<bool>>(false))
+{
+    m_statPool.setMaxThreadCount(1);
+
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd >= 0) {
+        m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &SDirWatcher::readEvents);
+    } else {
+        // Out of inotify instances probably, at least keep working
+        m_fallback = new QFileSystemWatcher(this);
+        connect(m_fallback, &QFileSystemWatcher::directoryChanged, this, [this](const QString &path) {
+            m_pendingRelist.insert(path);
+            scheduleFlush();
+        });
+    }
+
+    // Unpacking an archive or a build shouldn't make us relist or stat
+    // everything for every single entry
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(200);
+    connect(&m_flushTimer, &QTimer::timeout, this, &SDirWatcher::flush);
+}
+
+SDirWatcher::~SDirWatcher()
+{
+    *m_cancelled = true;
+    m_statPool.clear();
+    m_statPool.waitForDone();
+
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+int SDirWatcher::maxWatches() const
+{
+    return m_maxWatches;
+}
+
+void SDirWatcher::setMaxWatches(int maxWatches)
+{
+    m_maxWatches = qMax(1, maxWatches);
+    while (m_watches.count() > m_maxWatches && evictOne()) {
+    }
+}
+
+void SDirWatcher::addPath(const QString &path)
+{
+    auto it = m_watches.find(path);
+    if (it != m_watches.end()) {
+        m_lru.splice(m_lru.end(), m_lru, it->lruPosition);
+        return;
+    }
+
+    if (m_watches.count() >= m_maxWatches) {
+        evictOne();
+    }
+
+    int wd = -1;
+    if (m_fd >= 0) {
+        wd = inotify_add_watch(m_fd, QFile::encodeName(path).constData(), s_watchMask);
+        if (wd < 0) {
+            // Gone already, or out of watches; the former is reported by
+            // the parent, there's nothing we can do about the latter
+            return;
+        }
+
+        // The same directory under another name, e. g. through a symlink;
+        // there is only one watch for both
+        const QString otherPath = m_paths.value(wd);
+        if (!otherPath.isEmpty()) {
+            forget(otherPath);
+            Q_EMIT evicted(otherPath);
+        }
+        m_paths.insert(wd, path);
+    } else if (!m_fallback->addPath(path)) {
+        return;
+    }
+
+    m_lru.push_back(path);
+    m_watches.insert(path, Watch{wd, std::prev(m_lru.end())});
+}
+
+void SDirWatcher::removePath(const QString &path)
+{
+    const auto it = m_watches.constFind(path);
+    if (it == m_watches.constEnd()) {
+        return;
+    }
+
+    if (it->wd >= 0) {
+        inotify_rm_watch(m_fd, it->wd);
+    } else if (m_fallback) {
+        m_fallback->removePath(path);
+    }
+    forget(path);
+}
+
+void SDirWatcher::removeAllPaths()
+{
+    if (m_fd >= 0) {
+        for (auto it = m_paths.constBegin(); it != m_paths.constEnd(); ++it) {
+            inotify_rm_watch(m_fd, it.key());
+        }
+    } else {
+        const QStringList watched = m_fallback->directories();
+        if (!watched.isEmpty()) {
+            m_fallback->removePaths(watched);
+        }
+    }
+
+    m_watches.clear();
+    m_paths.clear();
+    m_lru.clear();
+    m_pinned.clear();
+    m_pendingNames.clear();
+    m_pendingRelist.clear();
+    m_flushTimer.stop();
+
+    *m_cancelled = true;
+    m_cancelled = std::make_shared<std::atomic<bool>>(false);
+    m_statPool.clear();
+    m_generation++;
+}
+
+bool SDirWatcher::contains(const QString &path) const
+{
+    return m_watches.contains(path);
+}
+
+void SDirWatcher::setPinned(const QString &path, bool pinned)
+{
+    if (pinned) {
+        m_pinned.insert(path);
+        return;
+    }
+
+    m_pinned.remove(path);
+
+    // Just collapsed, so it's the last unpinned one we want to get rid of
+    const auto it = m_watches.constFind(path);
+    if (it != m_watches.constEnd()) {
+        m_lru.splice(m_lru.end(), m_lru, it->lruPosition);
+    }
+}
+
+bool SDirWatcher::evictOne()
+{
+    for (const QString &path : m_lru) {
+        if (m_pinned.contains(path)) {
+            continue;
+        }
+
+        const QString evictedPath = path;
+        removePath(evictedPath);
+        Q_EMIT evicted(evictedPath);
+        return true;
+    }
+
+    // Everything is pinned; we rather go over the limit than lie about
+    // what's watched
+    return false;
+}
+
+void SDirWatcher::forget(const QString &path)
+{
+    const auto it = m_watches.find(path);
+    if (it == m_watches.end()) {
+        return;
+    }
+
+    if (it->wd >= 0) {
+        m_paths.remove(it->wd);
+    }
+    m_lru.erase(it->lruPosition);
+    m_watches.erase(it);
+    m_pendingNames.remove(path);
+    m_pendingRelist.remove(path);
+}
+
+void SDirWatcher::readEvents()
+{
+    alignas(struct inotify_event) char buffer[16 * 1024];
+
+    for (;;) {
+        const ssize_t length = read(m_fd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            break;
+        }
+
+        for (const char *ptr = buffer; ptr < buffer + length;) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // We lost track, everything has to be listed again
+                for (const QString &path : qAsConst(m_lru)) {
+                    m_pendingRelist.insert(path);
+                }
+                continue;
+            }
+
+            const QString path = m_paths.value(event->wd);
+            if (path.isEmpty()) {
+                continue;
+            }
+
+            if (event->mask & IN_IGNORED) {
+                // Removed by the kernel (the directory was deleted) or by us
+                forget(path);
+                continue;
+            }
+
+            if (event->mask & IN_MOVE_SELF) {
+                // The watch would follow it to wherever it went, under the
+                // old name. The parent tells about the rename, if we watch it.
+                inotify_rm_watch(m_fd, event->wd);
+                forget(path);
+                Q_EMIT evicted(path);
+                continue;
+            }
+
+            if (event->len > 0) {
+                m_pendingNames[path].insert(QFile::decodeName(event->name), event->mask);
+            }
+        }
+    }
+
+    if (!m_pendingNames.isEmpty() || !m_pendingRelist.isEmpty()) {
+        scheduleFlush();
+    }
+}
+
+void SDirWatcher::scheduleFlush()
+{
+    // Not restarted, so a directory that never settles is still updated
+    if (!m_flushTimer.isActive()) {
+        m_flushTimer.start();
+    }
+}
+
+void SDirWatcher::flush()
+{
+    const QHash<QString, QHash<QString, uint32_t>> pendingNames = std::move(m_pendingNames);
+    const QSet<QString> pendingRelist = std::move(m_pendingRelist);
+    m_pendingNames.clear();
+    m_pendingRelist.clear();
+
+    for (const QString &path : pendingRelist) {
+        if (m_watches.contains(path)) {
+            Q_EMIT directoryChanged(path);
+        }
+    }
+
+    QVector<Change> changes;
+    for (auto it = pendingNames.constBegin(); it != pendingNames.constEnd(); ++it) {
+        const QString &path = it.key();
+        if (pendingRelist.contains(path) || !m_watches.contains(path)) {
+            continue;
+        }
+
+        // The last event tells where a name ended up
+        Change change;
+        change.path = path;
+        for (auto name = it->constBegin(); name != it->constEnd(); ++name) {
+            const uint32_t mask = name.value();
+            if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+                change.removed.append(name.key());
+            } else if (mask & IN_ISDIR) {
+                change.added.append(name.key());
+            } else {
+                change.unknown.append(name.key());
+            }
+        }
+        changes.append(change);
+    }
+
+    if (!changes.isEmpty()) {
+        // Even when nothing has to be stat'ed, to keep the order
+        m_statPool.start(new StatJob(this, changes));
+    }
+}
+
+void SDirWatcher::changesChecked(quint64 generation, const QVector<Change> &changes)
+{
+    if (generation != m_generation) {
+        return;
+    }
+
+    for (const Change &change : changes) {
+        // Might have been removed in the meantime
+        if (m_watches.contains(change.path)) {
+            Q_EMIT entriesChanged(change.path, change.added, change.removed);
+        }
+    }
+}
+
+#include "moc_sdirwatcher.cpp"
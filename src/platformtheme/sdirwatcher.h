@@ -0,0 +1,152 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef SDIRWATCHER_H
+#define SDIRWATCHER_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+
+#include <atomic>
+#include <list>
+#include <memory>
+
+class QFileSystemWatcher;
+class QSocketNotifier;
+
+/**
+ * Watches a bounded set of directories for subdirectories coming and going.
+ *
+ * Uses inotify directly instead of going through KDirWatch, which tends to
+ * fall back to polling once a tree has a lot of expanded folders. Events are
+ * collected per directory and reported as one batch of added and removed
+ * names, so a model can apply them as a diff without relisting anything.
+ *
+ * At most maxWatches() directories are watched. When another one is added,
+ * the least recently used directory that isn't pinned is dropped, and
+ * evicted() is emitted for it; whoever listed it can't trust that listing
+ * anymore. Pinned directories (the expanded ones in a tree) are never
+ * evicted.
+ *
+ * Entries that came with IN_ISDIR, or went away, are reported as the events
+ * say. The others might be symlinks to directories; they're stat'ed on a
+ * thread of our own, so a slow filesystem can't block the caller.
+ *
+ * If inotify isn't available, QFileSystemWatcher is used, and every change
+ * is reported through directoryChanged() instead.
+ */
+class SDirWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SDirWatcher(QObject *parent = nullptr);
+    ~SDirWatcher() override;
+
+    /**
+     * The number of directories watched at once, 512 by default.
+     */
+    int maxWatches() const;
+    void setMaxWatches(int maxWatches);
+
+    /**
+     * Starts watching @p path, or marks it as the most recently used one if
+     * it's already watched.
+     */
+    void addPath(const QString &path);
+
+    /**
+     * Stops watching @p path, without emitting evicted().
+     */
+    void removePath(const QString &path);
+
+    /**
+     * Stops watching everything, and forgets which paths are pinned.
+     */
+    void removeAllPaths();
+
+    /**
+     * Returns whether @p path is currently watched.
+     */
+    bool contains(const QString &path) const;
+
+    /**
+     * Sets whether @p path may be evicted. Can be called before the path
+     * is watched.
+     */
+    void setPinned(const QString &path, bool pinned);
+
+Q_SIGNALS:
+    /**
+     * The (sub)directories @p added appeared in @p path, and the entries
+     * @p removed are gone or aren't directories anymore.
+     */
+    void entriesChanged(const QString &path, const QStringList &added, const QStringList &removed);
+
+    /**
+     * Something changed in @p path, but we don't know what; it has to be
+     * listed again.
+     */
+    void directoryChanged(const QString &path);
+
+    /**
+     * @p path isn't watched anymore, to make room for another directory or
+     * because it was moved away.
+     */
+    void evicted(const QString &path);
+
+private:
+    struct Watch {
+        int wd;
+        std::list<QString>::iterator lruPosition;
+    };
+
+    // What a flush found out about one directory, the unknown entries are
+    // sorted into added and removed by the stat job
+    struct Change {
+        QString path;
+        QStringList added;
+        QStringList removed;
+        QStringList unknown;
+    };
+    class StatJob;
+
+    void readEvents();
+    void flush();
+    void changesChecked(quint64 generation, const QVector<Change> &changes);
+    void scheduleFlush();
+    bool evictOne();
+    void forget(const QString &path);
+
+    int m_fd = -1;
+    QSocketNotifier *m_notifier = nullptr;
+    QFileSystemWatcher *m_fallback = nullptr;
+    int m_maxWatches = 512;
+
+    QHash<QString, Watch> m_watches;
+    QHash<int, QString> m_paths;
+    // Least recently used first
+    std::list<QString> m_lru;
+    QSet<QString> m_pinned;
+
+    // Collected until the flush timer fires, the last event mask per name
+    QHash<QString, QHash<QString, uint32_t>> m_pendingNames;
+    QSet<QString> m_pendingRelist;
+    QTimer m_flushTimer;
+
+    // One thread, so batches are reported in the order they happened
+    QThreadPool m_statPool;
+    // Bumped by removeAllPaths(), so batches for the old paths are dropped
+    quint64 m_generation = 0;
+    std::shared_ptr<std::atomic<bool>> m_cancelled;
+};
+
+#endif
@@ -7,8 +7,11 @@
  */
 
 #include "sfilemetapreview.h"
+#include "smediapreview.h"
+#include "stextpreview.h"
 
 #include <QLayout>
+#include <QSet>
 #include <qmimedatabase.h>
 
 #include <QDebug>
@@ -38,8 +41,11 @@ SFileMetaPreview::~SFileMetaPreview()
 
 void SFileMetaPreview::initPreviewProviders()
 {
-    qDeleteAll(m_previewProviders);
+    // Providers are registered for several mimetypes, only delete each once
+    const QList<KPreviewWidgetBase *> oldProviders = m_previewProviders.values();
+    qDeleteAll(QSet<KPreviewWidgetBase *>(oldProviders.begin(), oldProviders.end()));
     m_previewProviders.clear();
+    m_resolvedProviders.clear();
     // hardcoded so far
 
     // image previews
@@ -54,6 +60,20 @@ void SFileMetaPreview::initPreviewProviders()
 //         qDebug(".... %s", (*it).toLatin1().constData());
         m_previewProviders.insert(*it, imagePreview);
     }
+
+    // text and source files, only the start of the file is read
+    STextPreview *textPreview = new STextPreview(m_stack);
+    (void) m_stack->addWidget(textPreview);
+    for (const QString &mimeType : textPreview->supportedMimeTypes()) {
+        m_previewProviders.insert(mimeType, textPreview);
+    }
+
+    // pdf, audio and video, we just show what we can find in the headers
+    SMediaPreview *mediaPreview = new SMediaPreview(m_stack);
+    (void) m_stack->addWidget(mediaPreview);
+    for (const QString &mimeType : mediaPreview->supportedMimeTypes()) {
+        m_previewProviders.insert(mimeType, mediaPreview);
+    }
 }
 
 KPreviewWidgetBase *SFileMetaPreview::findExistingProvider(const QString &mimeType, const QMimeType &mimeInfo) const
@@ -88,6 +108,13 @@ KPreviewWidgetBase *SFileMetaPreview::findExistingProvider(const QString &mimeTy
 
 KPreviewWidgetBase *SFileMetaPreview::previewProviderFor(const QString &mimeType)
 {
+    // Most of the time we're just navigating over the same handful of types,
+    // so avoid walking the mimetype ancestors every time.
+    QHash<QString, KPreviewWidgetBase *>::const_iterator cached = m_resolvedProviders.constFind(mimeType);
+    if (cached != m_resolvedProviders.constEnd()) {
+        return cached.value();
+    }
+
     QMimeDatabase db;
     QMimeType mimeInfo = db.mimeTypeForName(mimeType);
 
@@ -98,23 +125,12 @@ KPreviewWidgetBase *SFileMetaPreview::previewProviderFor(const QString &mimeType
     //    return nullptr;
     //}
 
-    KPreviewWidgetBase *provider = findExistingProvider(mimeType, mimeInfo);
-    if (provider) {
-        return provider;
-    }
-
-//qDebug("#### didn't find anything for: %s", mimeType.toLatin1().constData());
-
-    // with the new mimetypes from the audio-preview, try again
-    provider = findExistingProvider(mimeType, mimeInfo);
-    if (provider) {
-        return provider;
-    }
-
     // The logic in this code duplicates the logic in PreviewJob.
     // But why do we need multiple KPreviewWidgetBase instances anyway?
+    KPreviewWidgetBase *provider = findExistingProvider(mimeType, mimeInfo);
+    m_resolvedProviders.insert(mimeType, provider);
 
-    return nullptr;
+    return provider;
 }
 
 void SFileMetaPreview::showPreview(const QUrl &url)
@@ -153,16 +169,19 @@ void SFileMetaPreview::addPreviewProvider(const QString &mimeType,
         KPreviewWidgetBase *provider)
 {
     m_previewProviders.insert(mimeType, provider);
+    m_resolvedProviders.clear();
 }
 
 void SFileMetaPreview::clearPreviewProviders()
 {
-    QHash<QString, KPreviewWidgetBase *>::const_iterator i = m_previewProviders.constBegin();
-    while (i != m_previewProviders.constEnd()) {
-        m_stack->removeWidget(i.value());
-        ++i;
+    // Providers are registered for several mimetypes, only delete each once
+    const QList<KPreviewWidgetBase *> registered = m_previewProviders.values();
+    const QSet<KPreviewWidgetBase *> providers(registered.begin(), registered.end());
+    for (KPreviewWidgetBase *provider : providers) {
+        m_stack->removeWidget(provider);
     }
-    qDeleteAll(m_previewProviders);
+    qDeleteAll(providers);
     m_previewProviders.clear();
+    m_resolvedProviders.clear();
 }
 
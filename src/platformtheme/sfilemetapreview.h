@@ -41,6 +41,10 @@ private:
     QWidget *m_blankWidget;
     QHash<QString, KPreviewWidgetBase *> m_previewProviders;
 
+    // Resolved mimetype -> provider, nullptr meaning "no provider". Filled
+    // lazily by previewProviderFor(), dropped whenever the providers change.
+    QHash<QString, KPreviewWidgetBase *> m_resolvedProviders;
+
 private:
     class SFileMetaPreviewPrivate;
     SFileMetaPreviewPrivate *d;
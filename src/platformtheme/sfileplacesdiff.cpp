@@ -0,0 +1,160 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-only
+*/
+
+#include "sfileplacesdiff_p.h"
+
+#include <QHash>
+
+namespace SFilePlacesDiff
+{
+Plan diff(const QVector<quint64> &oldIds, const QVector<quint64> &newIds)
+{
+    Plan plan;
+
+    // Ids should be unique, if they aren't the extra ones are just new rows
+    QHash<quint64, int> newRows;
+    newRows.reserve(newIds.count());
+    for (int row = 0; row < newIds.count(); ++row) {
+        if (!newRows.contains(newIds.at(row))) {
+            newRows.insert(newIds.at(row), row);
+        }
+    }
+
+    // The new row of every row we have, -1 if it's gone
+    QVector<int> targets(oldIds.count(), -1);
+    QVector<bool> newMatched(newIds.count(), false);
+    for (int row = 0; row < oldIds.count(); ++row) {
+        const auto it = newRows.constFind(oldIds.at(row));
+        if (it != newRows.constEnd() && !newMatched.at(*it)) {
+            targets[row] = *it;
+            newMatched[*it] = true;
+        }
+    }
+
+    // Remove what's gone, from the back
+    for (int last = targets.count() - 1; last >= 0;) {
+        if (targets.at(last) != -1) {
+            last--;
+            continue;
+        }
+
+        int first = last;
+        while (first > 0 && targets.at(first - 1) == -1) {
+            first--;
+        }
+
+        plan.removals.append({first, last, -1});
+        targets.remove(first, last - first + 1);
+        last = first - 1;
+    }
+
+    // Move what's out of order. Whatever is on the longest increasing run
+    // of new rows stays where it is, and everything else is put right after
+    // the row that precedes it in the new order. Rows that follow each other
+    // in both orders go together.
+    const QVector<bool> stays = longestIncreasingSubsequence(targets);
+    if (stays.contains(false)) {
+        const int count = targets.count();
+
+        // Ranks instead of new rows, so every one of them is taken
+        QVector<int> rankOfNewRow(newIds.count(), -1);
+        for (int newRow = 0, rank = 0; newRow < newIds.count(); ++newRow) {
+            if (newMatched.at(newRow)) {
+                rankOfNewRow[newRow] = rank++;
+            }
+        }
+
+        QVector<int> rankAtRow(count);
+        QVector<int> rowOfRank(count);
+        QVector<bool> moves(count);
+        for (int row = 0; row < count; ++row) {
+            const int rank = rankOfNewRow.at(targets.at(row));
+            rankAtRow[row] = rank;
+            rowOfRank[rank] = row;
+            moves[rank] = !stays.at(row);
+        }
+
+        int previous = -1;
+        for (int rank = 0; rank < count;) {
+            if (!moves.at(rank)) {
+                previous = rank++;
+                continue;
+            }
+
+            int last = rank;
+            while (last + 1 < count && moves.at(last + 1) && rowOfRank.at(last + 1) == rowOfRank.at(last) + 1) {
+                last++;
+            }
+
+            const int from = rowOfRank.at(rank);
+            const int length = last - rank + 1;
+            const int to = previous == -1 ? 0 : rowOfRank.at(previous) + 1;
+            if (to < from || to > from + length) {
+                const Range move = {from, from + length - 1, to};
+                plan.moves.append(move);
+                moveRange(rankAtRow, move);
+
+                // Only the rows in between changed places
+                const int begin = qMin(from, to);
+                const int end = qMax(from + length, to);
+                for (int row = begin; row < end; ++row) {
+                    rowOfRank[rankAtRow.at(row)] = row;
+                }
+            }
+
+            previous = last;
+            rank = last + 1;
+        }
+
+        std::sort(targets.begin(), targets.end());
+    }
+    plan.targets = targets;
+
+    // And insert what's new. Everything before it is in place by then, so
+    // the rows are the new ones.
+    for (int newRow = 0; newRow < newIds.count(); ++newRow) {
+        if (newMatched.at(newRow)) {
+            continue;
+        }
+
+        int last = newRow;
+        while (last + 1 < newIds.count() && !newMatched.at(last + 1)) {
+            last++;
+        }
+
+        plan.insertions.append({newRow, last, -1});
+        newRow = last;
+    }
+
+    return plan;
+}
+
+QVector<bool> longestIncreasingSubsequence(const QVector<int> &values)
+{
+    QVector<int> tails; // for every length, the element with the smallest tail value
+    QVector<int> previous(values.count(), -1);
+    for (int i = 0; i < values.count(); ++i) {
+        const auto it = std::lower_bound(tails.begin(), tails.end(), values.at(i), [&values](int element, int value) {
+            return values.at(element) < value;
+        });
+        const int length = it - tails.begin();
+        if (length > 0) {
+            previous[i] = tails.at(length - 1);
+        }
+        if (length == tails.count()) {
+            tails.append(i);
+        } else {
+            tails[length] = i;
+        }
+    }
+
+    QVector<bool> result(values.count(), false);
+    for (int i = tails.isEmpty() ? -1 : tails.last(); i != -1; i = previous.at(i)) {
+        result[i] = true;
+    }
+    return result;
+}
+}
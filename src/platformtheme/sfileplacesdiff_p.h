@@ -0,0 +1,61 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-only
+*/
+
+#ifndef SFILEPLACESDIFF_P_H
+#define SFILEPLACESDIFF_P_H
+
+#include <QVector>
+
+#include <algorithm>
+
+/**
+ * Works out how to turn the rows of the places model into the ones of a
+ * reload, matched by place id, with as few row signals as possible.
+ *
+ * Whatever is gone is removed, whatever is out of order is moved, and then
+ * whatever is new is inserted, each in contiguous ranges. Views keep their
+ * selection and scroll position through all of that, which they wouldn't
+ * through a reset.
+ */
+namespace SFilePlacesDiff
+{
+struct Range {
+    int first;
+    int last;
+    // For moves, the row to move in front of, as beginMoveRows() wants it
+    int destination;
+};
+
+struct Plan {
+    // On the rows as they are when the range is applied, in order
+    QVector<Range> removals;
+    QVector<Range> moves;
+    QVector<Range> insertions;
+
+    // For every row left after the removals and moves, its new row
+    QVector<int> targets;
+};
+
+Plan diff(const QVector<quint64> &oldIds, const QVector<quint64> &newIds);
+
+// Marks the elements on the longest strictly increasing subsequence of
+// @p values, in O(n log n)
+QVector<bool> longestIncreasingSubsequence(const QVector<int> &values);
+
+// Moves the rows of @p move in @p list, like the model does after
+// beginMoveRows()
+template<typename List>
+void moveRange(List &list, const Range &move)
+{
+    if (move.destination < move.first) {
+        std::rotate(list.begin() + move.destination, list.begin() + move.first, list.begin() + move.last + 1);
+    } else {
+        std::rotate(list.begin() + move.first, list.begin() + move.last + 1, list.begin() + move.destination);
+    }
+}
+}
+
+#endif
@@ -0,0 +1,179 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-only
+*/
+
+#include "sfileplacesindex_p.h"
+
+#include <KLocalizedString>
+#include <QCryptographicHash>
+#include <QtEndian>
+#include <kprotocolinfo.h>
+
+static quint64 hashKey(const QString &key)
+{
+    const QByteArray hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1);
+    return qFromBigEndian<quint64>(hash.constData());
+}
+
+SFilePlacesIndex SFilePlacesIndex::fromBookmarks(const KBookmarkGroup &root)
+{
+    SFilePlacesIndex index;
+    for (KBookmark bookmark = root.first(); !bookmark.isNull(); bookmark = root.next(bookmark)) {
+        index.append(bookmark);
+    }
+    return index;
+}
+
+int SFilePlacesIndex::append(const KBookmark &bookmark)
+{
+    const int row = bookmarks.count();
+    const int newCount = row + 1;
+    bookmarks.resize(newCount);
+    placeIds.resize(newCount);
+    ids.resize(newCount);
+    udis.resize(newCount);
+    tags.resize(newCount);
+    appNames.resize(newCount);
+    urls.resize(newCount);
+    texts.resize(newCount);
+    iconNames.resize(newCount);
+    groupTypes.resize(newCount);
+    flags.resize(newCount);
+
+    setRow(row, bookmark);
+    return row;
+}
+
+void SFilePlacesIndex::setRow(int row, const KBookmark &bookmark)
+{
+    const QString udi = bookmark.metaDataItem(QStringLiteral("UDI"));
+    const QUrl url = bookmark.url();
+
+    quint8 rowFlags = 0;
+    if (bookmark.metaDataItem(QStringLiteral("IsHidden")) == QLatin1String("true")) {
+        rowFlags |= HiddenFlag;
+    }
+
+    QString text;
+    if (bookmark.metaDataItem(QStringLiteral("isSystemItem")) == QLatin1String("true")) {
+        rowFlags |= SystemItemFlag;
+
+        // This context must stay as it is - the translated system bookmark names
+        // are created with 'KFile System Bookmarks' as their context, so this
+        // ensures the right string is picked from the catalog.
+        // (coles, 13th May 2009)
+        text = i18nc("KFile System Bookmarks", bookmark.text().toUtf8().data());
+    } else {
+        text = bookmark.text();
+    }
+
+    bookmarks[row] = bookmark;
+    ids[row] = bookmark.metaDataItem(QStringLiteral("ID"));
+    if (!udi.isEmpty()) {
+        placeIds[row] = devicePlaceId(udi);
+    } else {
+        bool ok = false;
+        placeIds[row] = bookmark.metaDataItem(placeIdKey()).toULongLong(&ok);
+        if (!ok) {
+            placeIds[row] = bookmarkPlaceId(ids.at(row));
+            rowFlags |= PlaceIdMissingFlag;
+        }
+    }
+    udis[row] = udi;
+    tags[row] = bookmark.metaDataItem(QStringLiteral("tag"));
+    appNames[row] = bookmark.metaDataItem(QStringLiteral("OnlyInApp"));
+    urls[row] = url;
+    texts[row] = text;
+    iconNames[row] = bookmark.icon();
+    groupTypes[row] = udi.isEmpty() ? groupTypeForUrl(url) : SFilePlacesModel::DevicesType;
+    flags[row] = rowFlags;
+}
+
+void SFilePlacesIndex::setId(int row, const QString &id)
+{
+    const quint64 placeId = bookmarkPlaceId(id);
+    bookmarks[row].setMetaDataItem(QStringLiteral("ID"), id);
+    bookmarks[row].setMetaDataItem(placeIdKey(), QString::number(placeId));
+    ids[row] = id;
+    placeIds[row] = placeId;
+    flags[row] &= ~PlaceIdMissingFlag;
+}
+
+void SFilePlacesIndex::storePlaceId(int row)
+{
+    bookmarks[row].setMetaDataItem(placeIdKey(), QString::number(placeIds.at(row)));
+    flags[row] &= ~PlaceIdMissingFlag;
+}
+
+bool SFilePlacesIndex::rebind(const KBookmarkGroup &root)
+{
+    QVector<KBookmark> rebound;
+    rebound.reserve(bookmarks.count());
+    for (KBookmark bookmark = root.first(); !bookmark.isNull(); bookmark = root.next(bookmark)) {
+        const int row = rebound.count();
+        if (row == bookmarks.count() //
+            || bookmark.metaDataItem(QStringLiteral("ID")) != ids.at(row) //
+            || bookmark.metaDataItem(QStringLiteral("UDI")) != udis.at(row)) {
+            return false;
+        }
+        rebound.append(bookmark);
+    }
+
+    if (rebound.count() != bookmarks.count()) {
+        return false;
+    }
+    bookmarks = rebound;
+    return true;
+}
+
+bool SFilePlacesIndex::rowEquals(int row, const SFilePlacesIndex &other, int otherRow) const
+{
+    return urls.at(row) == other.urls.at(otherRow) //
+        && texts.at(row) == other.texts.at(otherRow) //
+        && iconNames.at(row) == other.iconNames.at(otherRow) //
+        && groupTypes.at(row) == other.groupTypes.at(otherRow) //
+        && (flags.at(row) & ~PlaceIdMissingFlag) == (other.flags.at(otherRow) & ~PlaceIdMissingFlag);
+}
+
+quint64 SFilePlacesIndex::bookmarkPlaceId(const QString &id)
+{
+    return hashKey(id) & ~(quint64(1) << 63);
+}
+
+quint64 SFilePlacesIndex::devicePlaceId(const QString &udi)
+{
+    return hashKey(udi) | (quint64(1) << 63);
+}
+
+QString SFilePlacesIndex::placeIdKey()
+{
+    return QStringLiteral("ID64");
+}
+
+SFilePlacesModel::GroupType SFilePlacesIndex::groupTypeForUrl(const QUrl &url)
+{
+    const QString protocol = url.scheme();
+    if (protocol == QLatin1String("timeline") || protocol == QLatin1String("recentlyused")) {
+        return SFilePlacesModel::RecentlySavedType;
+    }
+
+    if (protocol.contains(QLatin1String("search"))) {
+        return SFilePlacesModel::SearchForType;
+    }
+
+    if (protocol == QLatin1String("bluetooth") || protocol == QLatin1String("obexftp") || protocol == QLatin1String("kdeconnect")) {
+        return SFilePlacesModel::DevicesType;
+    }
+
+    if (protocol == QLatin1String("tags")) {
+        return SFilePlacesModel::TagsType;
+    }
+
+    if (protocol == QLatin1String("remote") || KProtocolInfo::protocolClass(protocol) != QLatin1String(":local")) {
+        return SFilePlacesModel::RemoteType;
+    } else {
+        return SFilePlacesModel::PlacesType;
+    }
+}
@@ -0,0 +1,118 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-only
+*/
+
+#ifndef SFILEPLACESINDEX_P_H
+#define SFILEPLACESINDEX_P_H
+
+#include "sfileplacesmodel.h"
+
+#include <KBookmark>
+#include <QString>
+#include <QUrl>
+#include <QVector>
+
+/**
+ * Everything the places model needs from the bookmarks, read once.
+ *
+ * Going through KBookmark means searching the DOM for every single value,
+ * every time, and the model used to do that for every data() call. Instead
+ * the bookmarks are read in one go whenever they change, into one column per
+ * value; the items only keep their row in here.
+ *
+ * Rows are never removed, a new index is built on every reload. Items of the
+ * previous reload keep theirs alive until they are updated or deleted. A
+ * single edit made by another process is read into its row in place.
+ */
+class SFilePlacesIndex
+{
+public:
+    enum Flag : quint8 {
+        HiddenFlag = 0x1,
+        SystemItemFlag = 0x2,
+        // The place id was made from the string ID, it isn't saved yet
+        PlaceIdMissingFlag = 0x4,
+    };
+
+    /**
+     * Reads all top level bookmarks of @p root.
+     */
+    static SFilePlacesIndex fromBookmarks(const KBookmarkGroup &root);
+
+    /**
+     * Reads @p bookmark into a new row, and returns that row.
+     */
+    int append(const KBookmark &bookmark);
+
+    /**
+     * Reads @p bookmark into @p row again, after it was edited.
+     */
+    void setRow(int row, const KBookmark &bookmark);
+
+    /**
+     * Gives the bookmark of @p row the string ID @p id, for bookmarks that
+     * were added without one.
+     */
+    void setId(int row, const QString &id);
+
+    /**
+     * Writes the place id of @p row to its bookmark, for bookmarks that were
+     * saved before there were any.
+     */
+    void storePlaceId(int row);
+
+    /**
+     * Points the rows at the bookmarks of @p root, after the document was
+     * parsed again without changing them. Returns false, and leaves the rows
+     * alone, unless @p root has the same bookmarks in the same order.
+     */
+    bool rebind(const KBookmarkGroup &root);
+
+    int count() const
+    {
+        return bookmarks.count();
+    }
+
+    bool isDevice(int row) const
+    {
+        return !udis.at(row).isEmpty();
+    }
+
+    bool isHidden(int row) const
+    {
+        return flags.at(row) & HiddenFlag;
+    }
+
+    /**
+     * Returns whether @p row shows the same as @p otherRow of @p other.
+     */
+    bool rowEquals(int row, const SFilePlacesIndex &other, int otherRow) const;
+
+    static SFilePlacesModel::GroupType groupTypeForUrl(const QUrl &url);
+
+    /**
+     * The id of a place, for comparing and looking up places. Bookmarks keep
+     * theirs next to their string ID, in case it was never saved it's made
+     * from the string ID. Devices' ones are made from their udi, with the top
+     * bit set so the two never meet.
+     */
+    static quint64 bookmarkPlaceId(const QString &id);
+    static quint64 devicePlaceId(const QString &udi);
+    static QString placeIdKey();
+
+    QVector<KBookmark> bookmarks;
+    QVector<quint64> placeIds;
+    QVector<QString> ids;
+    QVector<QString> udis;
+    QVector<QString> tags;
+    QVector<QString> appNames;
+    QVector<QUrl> urls;
+    QVector<QString> texts;
+    QVector<QString> iconNames;
+    QVector<SFilePlacesModel::GroupType> groupTypes;
+    QVector<quint8> flags;
+};
+
+#endif
@@ -6,8 +6,10 @@
 */
 
 #include "sfileplacesitem_p.h"
+#include "sdevicestatus.h"
 
 #include <QDateTime>
+#include <QFileInfo>
 #include <QIcon>
 
 #include <KBookmarkManager>
@@ -16,31 +18,46 @@
 #include <KIconUtils>
 #include <KLocalizedString>
 #include <QDebug>
-#include <kprotocolinfo.h>
 
-static bool isTrash(const KBookmark &bk)
+static bool isTrash(const QUrl &url)
 {
-    return bk.url().toString() == QLatin1String("trash:/");
+    return url.toString() == QLatin1String("trash:/");
 }
 
-SFilePlacesItem::SFilePlacesItem(KBookmarkManager *manager, const QString &address, const QString &udi, SFilePlacesModel *parent)
+static QString groupNameForType(SFilePlacesModel::GroupType type)
+{
+    switch (type) {
+    case SFilePlacesModel::PlacesType:
+        return i18nc("@item", "Places");
+    case SFilePlacesModel::RemoteType:
+        return i18nc("@item", "Remote");
+    case SFilePlacesModel::RecentlySavedType:
+        return i18nc("@item The place group section name for recent dynamic lists", "Recent");
+    case SFilePlacesModel::SearchForType:
+        return i18nc("@item", "Search For");
+    case SFilePlacesModel::DevicesType:
+        return i18nc("@item", "Devices");
+    case SFilePlacesModel::RemovableDevicesType:
+        return i18nc("@item", "Removable Devices");
+    case SFilePlacesModel::TagsType:
+        return i18nc("@item", "Tags");
+    default:
+        Q_UNREACHABLE();
+    }
+}
+
+SFilePlacesItem::SFilePlacesItem(const std::shared_ptr<SFilePlacesIndex> &index, int row, SFilePlacesModel *parent)
     : QObject(static_cast<QObject *>(parent))
-    , m_manager(manager)
     , m_folderIsEmpty(true)
     , m_isCdrom(false)
     , m_isAccessible(false)
 {
-    updateDeviceInfo(udi);
-    setBookmark(m_manager->findByAddress(address));
-
-    if (udi.isEmpty() && m_bookmark.metaDataItem(QStringLiteral("ID")).isEmpty()) {
-        m_bookmark.setMetaDataItem(QStringLiteral("ID"), generateNewId());
-    } else if (udi.isEmpty()) {
-        if (isTrash(m_bookmark)) {
-            KConfig cfg(QStringLiteral("trashrc"), KConfig::SimpleConfig);
-            const KConfigGroup group = cfg.group("Status");
-            m_folderIsEmpty = group.readEntry("Empty", true);
-        }
+    setIndexRow(index, row);
+
+    if (!isDevice() && isTrash(m_index->urls.at(m_row))) {
+        KConfig cfg(QStringLiteral("trashrc"), KConfig::SimpleConfig);
+        const KConfigGroup group = cfg.group("Status");
+        m_folderIsEmpty = group.readEntry("Empty", true);
     }
 }
 
@@ -48,100 +65,97 @@ SFilePlacesItem::~SFilePlacesItem()
 {
 }
 
-QString SFilePlacesItem::id() const
+quint64 SFilePlacesItem::placeId() const
 {
-    if (isDevice()) {
-        return bookmark().metaDataItem(QStringLiteral("UDI"));
-    } else {
-        return bookmark().metaDataItem(QStringLiteral("ID"));
-    }
+    return m_index->placeIds.at(m_row);
 }
 
-bool SFilePlacesItem::hasSupportedScheme(const QStringList &schemes) const
+void SFilePlacesItem::refreshDevice()
 {
-    if (schemes.isEmpty()) {
-        return true;
-    }
+    updateDeviceInfo(m_index->udis.at(m_row));
+    m_cacheValid = false;
+}
+
+const SMountWatcher::Mount &SFilePlacesItem::device() const
+{
+    return m_mount;
+}
 
-    // StorageAccess is always local, doesn't need to be accessible to know this
-    //if (m_access && schemes.contains(QLatin1String("file"))) {
-    //    return true;
-    //}
-
-    //if (m_networkShare && schemes.contains(m_networkShare->url().scheme())) {
-    //    return true;
-    //}
-
-    //if (m_player) {
-    //    const QStringList protocols = m_player->supportedProtocols();
-    //    for (const QString &protocol : protocols) {
-    //        if (schemes.contains(protocol)) {
-    //            return true;
-    //        }
-    //    }
-    //}
-
-    return false;
+void SFilePlacesItem::updateDeviceInfo(const QString &udi)
+{
+    if (udi.isEmpty()) {
+        m_mount = SMountWatcher::Mount();
+    } else {
+        m_mount = SMountWatcher::self()->mount(udi);
+    }
+    m_isCdrom = m_mount.fileSystemType == QLatin1String("iso9660") || m_mount.fileSystemType == QLatin1String("udf");
 }
 
 bool SFilePlacesItem::isDevice() const
 {
-    return !bookmark().metaDataItem(QStringLiteral("UDI")).isEmpty();
+    return m_index->isDevice(m_row);
 }
 
 KBookmark SFilePlacesItem::bookmark() const
 {
-    return m_bookmark;
+    return m_index->bookmarks.at(m_row);
 }
 
-void SFilePlacesItem::setBookmark(const KBookmark &bookmark)
+void SFilePlacesItem::setIndexRow(const std::shared_ptr<SFilePlacesIndex> &index, int row)
 {
-    m_bookmark = bookmark;
+    m_index = index;
+    m_row = row;
 
-    updateDeviceInfo(m_bookmark.metaDataItem(QStringLiteral("UDI")));
+    updateDeviceInfo(m_index->udis.at(m_row));
+    m_cacheValid = false;
+}
+
+void SFilePlacesItem::updateCache() const
+{
+    if (m_cacheValid) {
+        return;
+    }
+    m_cacheValid = true;
 
-    if (bookmark.metaDataItem(QStringLiteral("isSystemItem")) == QLatin1String("true")) {
-        // This context must stay as it is - the translated system bookmark names
-        // are created with 'KFile System Bookmarks' as their context, so this
-        // ensures the right string is picked from the catalog.
-        // (coles, 13th May 2009)
+    m_groupName = groupNameForType(groupType());
 
-        m_text = i18nc("KFile System Bookmarks", bookmark.text().toUtf8().data());
-    } else {
-        m_text = bookmark.text();
+    const QString name = isDevice() ? deviceIconName() : iconName();
+    if (name != m_iconName || m_icon.isNull()) {
+        m_iconName = name;
+        m_icon = QIcon::fromTheme(name);
     }
 
-    const SFilePlacesModel::GroupType type = groupType();
-    switch (type) {
-    case SFilePlacesModel::PlacesType:
-        m_groupName = i18nc("@item", "Places");
-        break;
-    case SFilePlacesModel::RemoteType:
-        m_groupName = i18nc("@item", "Remote");
-        break;
-    case SFilePlacesModel::RecentlySavedType:
-        m_groupName = i18nc("@item The place group section name for recent dynamic lists", "Recent");
-        break;
-    case SFilePlacesModel::SearchForType:
-        m_groupName = i18nc("@item", "Search For");
-        break;
-    case SFilePlacesModel::DevicesType:
-        m_groupName = i18nc("@item", "Devices");
-        break;
-    case SFilePlacesModel::RemovableDevicesType:
-        m_groupName = i18nc("@item", "Removable Devices");
-        break;
-    case SFilePlacesModel::TagsType:
-        m_groupName = i18nc("@item", "Tags");
+    m_text = isDevice() ? deviceText() : m_index->texts.at(m_row);
+}
+
+const SFilePlacesIndex &SFilePlacesItem::index() const
+{
+    return *m_index;
+}
+
+const std::shared_ptr<SFilePlacesIndex> &SFilePlacesItem::sharedIndex() const
+{
+    return m_index;
+}
+
+int SFilePlacesItem::indexRow() const
+{
+    return m_row;
+}
+
+QVariant SFilePlacesItem::data(int role) const
+{
+    switch (role) {
+    case SFilePlacesModel::GroupRole:
+    case Qt::DisplayRole:
+    case Qt::DecorationRole:
+    case SFilePlacesModel::IconNameRole:
+        updateCache();
         break;
     default:
-        Q_UNREACHABLE();
         break;
     }
-}
 
-QVariant SFilePlacesItem::data(int role) const
-{
     if (role == SFilePlacesModel::GroupRole) {
         return QVariant(m_groupName);
     } else if (role != SFilePlacesModel::HiddenRole && role != Qt::BackgroundRole && isDevice()) {
@@ -153,58 +167,44 @@ QVariant SFilePlacesItem::data(int role) const
 
 SFilePlacesModel::GroupType SFilePlacesItem::groupType() const
 {
-    if (!isDevice()) {
-        const QString protocol = bookmark().url().scheme();
-        if (protocol == QLatin1String("timeline") || protocol == QLatin1String("recentlyused")) {
-            return SFilePlacesModel::RecentlySavedType;
-        }
-
-        if (protocol.contains(QLatin1String("search"))) {
-            return SFilePlacesModel::SearchForType;
-        }
-
-        if (protocol == QLatin1String("bluetooth") || protocol == QLatin1String("obexftp") || protocol == QLatin1String("kdeconnect")) {
-            return SFilePlacesModel::DevicesType;
-        }
-
-        if (protocol == QLatin1String("tags")) {
-            return SFilePlacesModel::TagsType;
-        }
+    return groupType(*m_index, m_row, m_mount);
+}
 
-        if (protocol == QLatin1String("remote") || KProtocolInfo::protocolClass(protocol) != QLatin1String(":local")) {
+SFilePlacesModel::GroupType SFilePlacesItem::groupType(const SFilePlacesIndex &index, int row, const SMountWatcher::Mount &mount)
+{
+    if (index.isDevice(row)) {
+        if (mount.network) {
             return SFilePlacesModel::RemoteType;
-        } else {
-            return SFilePlacesModel::PlacesType;
+        } else if (mount.removable) {
+            return SFilePlacesModel::RemovableDevicesType;
         }
     }
-
-    //if (m_drive && (m_drive->isHotpluggable() || m_drive->isRemovable())) {
-    //    return SFilePlacesModel::RemovableDevicesType;
-    ////} else if (m_networkShare) {
-    ////    return SFilePlacesModel::RemoteType;
-    //} else {
-        return SFilePlacesModel::DevicesType;
-    //}
+    return index.groupTypes.at(row);
 }
 
 bool SFilePlacesItem::isHidden() const
 {
-    return m_bookmark.metaDataItem(QStringLiteral("IsHidden")) == QLatin1String("true");
+    return m_index->isHidden(m_row);
 }
 
 void SFilePlacesItem::setHidden(bool hide)
 {
-    if (m_bookmark.isNull() || isHidden() == hide) {
+    if (bookmark().isNull() || isHidden() == hide) {
         return;
     }
-    m_bookmark.setMetaDataItem(QStringLiteral("IsHidden"), hide ? QStringLiteral("true") : QStringLiteral("false"));
+    m_index->bookmarks[m_row].setMetaDataItem(QStringLiteral("IsHidden"), hide ? QStringLiteral("true") : QStringLiteral("false"));
+
+    // Don't wait for the reload to see it
+    if (hide) {
+        m_index->flags[m_row] |= SFilePlacesIndex::HiddenFlag;
+    } else {
+        m_index->flags[m_row] &= ~SFilePlacesIndex::HiddenFlag;
+    }
 }
 
 QVariant SFilePlacesItem::bookmarkData(int role) const
 {
-    KBookmark b = bookmark();
-
-    if (b.isNull()) {
+    if (bookmark().isNull()) {
         return QVariant();
     }
 
@@ -212,7 +212,7 @@ QVariant SFilePlacesItem::bookmarkData(int role) const
     case Qt::DisplayRole:
         return m_text;
     case Qt::DecorationRole:
-        return QIcon::fromTheme(iconNameForBookmark(b));
+        return m_icon;
     case Qt::BackgroundRole:
         if (isHidden()) {
             return QColor(Qt::lightGray);
@@ -220,13 +220,13 @@ QVariant SFilePlacesItem::bookmarkData(int role) const
             return QVariant();
         }
     case SFilePlacesModel::UrlRole:
-        return b.url();
+        return m_index->urls.at(m_row);
     case SFilePlacesModel::SetupNeededRole:
         return false;
     case SFilePlacesModel::HiddenRole:
         return isHidden();
     case SFilePlacesModel::IconNameRole:
-        return iconNameForBookmark(b);
+        return m_iconName;
     default:
         return QVariant();
     }
@@ -234,26 +234,36 @@ QVariant SFilePlacesItem::bookmarkData(int role) const
 
 QVariant SFilePlacesItem::deviceData(int role) const
 {
-    if (m_device.isValid()) {
+    if (!m_mount.mountPoint.isEmpty()) {
         switch (role) {
         case Qt::DisplayRole:
-            return m_device.displayName();
+            return m_text;
         case Qt::DecorationRole:
-            // qDebug() << "adding emblems" << m_emblems << "to device icon" << m_deviceIconName;
-            return QIcon::fromTheme("drive-harddisk");
+            return m_icon;
         case SFilePlacesModel::UrlRole:
-            return QUrl::fromLocalFile(m_device.rootPath());
-        case SFilePlacesModel::SetupNeededRole:
-            return !m_device.isReady();
+            return QUrl::fromLocalFile(m_mount.mountPoint);
+        case SFilePlacesModel::SetupNeededRole: {
+            // Only answers from the cache, a dead mount can't block us here
+            const SDeviceStatus::Status status = SDeviceStatus::self()->status(m_mount.mountPoint);
+            return status.known && !status.ready;
+        }
 
         case SFilePlacesModel::FixedDeviceRole:
-            return true;
+            return !m_mount.removable;
 
         case SFilePlacesModel::CapacityBarRecommendedRole:
-            return m_device.isReady();
+            return SDeviceStatus::self()->status(m_mount.mountPoint).ready;
+
+        case SFilePlacesModel::CapacityRole: {
+            const SDeviceStatus::Status status = SDeviceStatus::self()->status(m_mount.mountPoint);
+            if (!status.ready || status.size == 0) {
+                return QVariant();
+            }
+            return int(((status.size - status.available) * 100) / status.size);
+        }
 
         case SFilePlacesModel::IconNameRole:
-            return "drive-harddisk";
+            return m_iconName;
 
         default:
             return QVariant();
@@ -278,7 +288,9 @@ KBookmark SFilePlacesItem::createBookmark(KBookmarkManager *manager, const QStri
         }
     }
     KBookmark bookmark = root.addBookmark(label, url, empty_icon);
-    bookmark.setMetaDataItem(QStringLiteral("ID"), generateNewId());
+    const QString id = generateNewId();
+    bookmark.setMetaDataItem(QStringLiteral("ID"), id);
+    bookmark.setMetaDataItem(SFilePlacesIndex::placeIdKey(), QString::number(SFilePlacesIndex::bookmarkPlaceId(id)));
 
     if (after) {
         root.moveBookmark(bookmark, after->bookmark());
@@ -343,18 +355,41 @@ QString SFilePlacesItem::generateNewId()
 void SFilePlacesItem::onAccessibilityChanged(bool isAccessible)
 {
     m_isAccessible = isAccessible;
-    m_isCdrom = m_device.fileSystemType() == "iso9660";
+    m_cacheValid = false;
 
-    Q_EMIT itemChanged(id());
+    Q_EMIT itemChanged(placeId());
 }
 
-QString SFilePlacesItem::iconNameForBookmark(const KBookmark &bookmark) const
+QString SFilePlacesItem::iconName() const
 {
-    if (!m_folderIsEmpty && isTrash(bookmark)) {
-        return bookmark.icon() + QLatin1String("-full");
+    const QString &iconName = m_index->iconNames.at(m_row);
+    if (!m_folderIsEmpty && isTrash(m_index->urls.at(m_row))) {
+        return iconName + QLatin1String("-full");
     } else {
-        return bookmark.icon();
+        return iconName;
+    }
+}
+
+QString SFilePlacesItem::deviceText() const
+{
+    if (!m_mount.label.isEmpty()) {
+        return m_mount.label;
+    } else if (m_mount.mountPoint == QLatin1String("/")) {
+        return i18nc("@item the root filesystem", "Root");
+    }
+    return QFileInfo(m_mount.mountPoint).fileName();
+}
+
+QString SFilePlacesItem::deviceIconName() const
+{
+    if (m_isCdrom) {
+        return QStringLiteral("media-optical");
+    } else if (m_mount.network) {
+        return QStringLiteral("folder-remote");
+    } else if (m_mount.removable) {
+        return QStringLiteral("drive-removable-media-usb");
     }
+    return QStringLiteral("drive-harddisk");
 }
 
 #include "moc_sfileplacesitem_p.cpp"
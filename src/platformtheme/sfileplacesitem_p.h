@@ -8,13 +8,17 @@
 #ifndef sfileplacESITEM_P_H
 #define sfileplacESITEM_P_H
 
+#include "sfileplacesindex_p.h"
 #include "sfileplacesmodel.h"
+#include "smountwatcher.h"
 #include <KBookmark>
+#include <QIcon>
 #include <QObject>
 #include <QPointer>
 #include <QStringList>
 #include <QUrl>
-#include <QStorageInfo>
+
+#include <memory>
 
 class KDirLister;
 
@@ -32,21 +36,36 @@ public:
         TagsType,
     };
 
-    SFilePlacesItem(KBookmarkManager *manager, const QString &address, const QString &udi, SFilePlacesModel *parent);
+    SFilePlacesItem(const std::shared_ptr<SFilePlacesIndex> &index, int row, SFilePlacesModel *parent);
     ~SFilePlacesItem();
 
-    QString id() const;
+    quint64 placeId() const;
 
     bool isDevice() const;
     KBookmark bookmark() const;
-    void setBookmark(const KBookmark &bookmark);
-    QStorageInfo device() const;
+
+    /**
+     * Makes the item show @p row of @p index, after a reload.
+     */
+    void setIndexRow(const std::shared_ptr<SFilePlacesIndex> &index, int row);
+    const SFilePlacesIndex &index() const;
+    const std::shared_ptr<SFilePlacesIndex> &sharedIndex() const;
+    int indexRow() const;
+    const SMountWatcher::Mount &device() const;
     QVariant data(int role) const;
     SFilePlacesModel::GroupType groupType() const;
+    /**
+     * The group @p row of @p index goes in, for a device mounted as @p mount.
+     */
+    static SFilePlacesModel::GroupType groupType(const SFilePlacesIndex &index, int row, const SMountWatcher::Mount &mount);
     bool isHidden() const;
     void setHidden(bool hide);
 
-    bool hasSupportedScheme(const QStringList &schemes) const;
+    /**
+     * Picks up the current state of the device from SMountWatcher, after it
+     * said the mount changed.
+     */
+    void refreshDevice();
 
     static KBookmark
     createBookmark(KBookmarkManager *manager, const QString &label, const QUrl &url, const QString &iconName, SFilePlacesItem *after = nullptr);
@@ -58,9 +77,10 @@ public:
                                           const KBookmark &after = KBookmark());
     static KBookmark createDeviceBookmark(KBookmarkManager *manager, const QString &udi);
     static KBookmark createTagBookmark(KBookmarkManager *manager, const QString &tag);
+    static QString generateNewId();
 
 Q_SIGNALS:
-    void itemChanged(const QString &id);
+    void itemChanged(quint64 placeId);
 
 private Q_SLOTS:
     void onAccessibilityChanged(bool);
@@ -69,23 +89,27 @@ private:
     QVariant bookmarkData(int role) const;
     QVariant deviceData(int role) const;
 
-    QString iconNameForBookmark(const KBookmark &bookmark) const;
+    QString iconName() const;
 
-    static QString generateNewId();
-    bool updateDeviceInfo(const QString &udi) {
-        m_device.setPath(udi);
-    }
+    void updateDeviceInfo(const QString &udi);
+    QString deviceIconName() const;
+    QString deviceText() const;
+
+    // The roles that take more than a lookup, resolved on the first data()
+    // call after the row or the device changed instead of on every paint
+    void updateCache() const;
+    mutable bool m_cacheValid = false;
+    mutable QString m_groupName;
+    mutable QString m_text;
+    mutable QString m_iconName;
+    mutable QIcon m_icon;
 
-    KBookmarkManager *m_manager;
-    KBookmark m_bookmark;
+    std::shared_ptr<SFilePlacesIndex> m_index;
+    int m_row;
     bool m_folderIsEmpty;
     bool m_isCdrom;
     bool m_isAccessible;
-    QString m_text;
-    QStorageInfo m_device;
-    QString m_deviceIconName;
-    QStringList m_emblems;
-    QString m_groupName;
+    SMountWatcher::Mount m_mount;
 };
 
 #endif
@@ -7,7 +7,11 @@
 */
 
 #include "sfileplacesmodel.h"
+#include "sfileplacesdiff_p.h"
 #include "sfileplacesitem_p.h"
+#include "sdevicestatus.h"
+#include "sfileplacestrie_p.h"
+#include "smountwatcher.h"
 
 #ifdef _WIN32_WCE
 #include "WinBase.h"
@@ -16,8 +20,12 @@
 
 #include <QAction>
 #include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusMessage>
 #include <QDir>
+#include <QDomDocument>
 #include <QFile>
+#include <QFileInfo>
 #include <QMimeData>
 #include <QMimeDatabase>
 #include <QTimer>
@@ -39,6 +47,8 @@
 
 #include <QStandardPaths>
 
+#include <sys/stat.h>
+
 namespace
 {
 QString stateNameForGroupType(SFilePlacesModel::GroupType type)
@@ -65,9 +75,13 @@ QString stateNameForGroupType(SFilePlacesModel::GroupType type)
 
 static bool isFileIndexingEnabled()
 {
-    KConfig config(QStringLiteral("baloofilerc"));
-    KConfigGroup basicSettings = config.group("Basic Settings");
-    return basicSettings.readEntry("Indexing-Enabled", true);
+    // Read once per process, not for every dialog
+    static const bool enabled = [] {
+        KConfig config(QStringLiteral("baloofilerc"));
+        KConfigGroup basicSettings = config.group("Basic Settings");
+        return basicSettings.readEntry("Indexing-Enabled", true);
+    }();
+    return enabled;
 }
 
 static QString timelineDateString(int year, int month, int day = 0)
@@ -196,8 +210,73 @@ public:
 
     QString alternativeApplicationName;
 
-    void reloadAndSignal();
-    QList<SFilePlacesItem *> loadBookmarkList();
+    // Bit n is set when GroupType n is hidden. Read from the bookmarks root
+    // on first use, and again after every reload.
+    quint32 groupHiddenMask() const;
+    void setGroupHiddenBit(SFilePlacesModel::GroupType type, bool hidden);
+    mutable quint32 groupHiddenBits = 0;
+    mutable bool groupHiddenBitsValid = false;
+
+    // For closestItem(), kept up to date with the items
+    SFilePlacesTrie urlTrie;
+
+    // Counted per group, so hiding or showing a whole group needs no
+    // recount. Every change to the items goes through trackItem().
+    void trackItem(const SFilePlacesItem *item, int delta);
+    int groupItemCounts[SFilePlacesModel::TagsType + 1] = {};
+    int groupHiddenPlaceCounts[SFilePlacesModel::TagsType + 1] = {};
+    mutable QVector<int> visibleRows;
+    mutable bool visibleRowsValid = false;
+
+    // Rebuilt on first use after rows were inserted, removed or moved. The
+    // ids of items don't change otherwise, they're matched by them.
+    int rowOf(const SFilePlacesItem *item) const;
+    QList<SFilePlacesItem *> itemsWithId(quint64 placeId) const;
+    void updateItemLookup() const;
+    mutable QHash<const SFilePlacesItem *, int> itemRows;
+    mutable QMultiHash<quint64, SFilePlacesItem *> itemsById;
+    mutable bool itemRowsValid = false;
+
+    // What user-places.xbel looked like when we last read or wrote it, to
+    // tell changes from other processes apart from echoes of our own saves
+    QString bookmarksFile;
+    QByteArray bookmarksStamp;
+    QDomDocument bookmarksDocument;
+    bool savingBookmarks = false;
+    QByteArray readBookmarksStamp() const;
+
+    // The index all items are on since the last reload
+    std::shared_ptr<SFilePlacesIndex> bookmarksIndex;
+
+    // Announced over D-Bus by the process that made the edit, instead of the
+    // broadcast of KBookmarkManager, so the others can read only that
+    // bookmark instead of reloading everything. Arrives before or after
+    // KBookmarkManager noticed the file changed.
+    struct PlaceDelta {
+        QByteArray previousStamp;
+        QByteArray stamp;
+        QString address;
+    };
+    PlaceDelta pendingDelta;
+    void announceChange(const QByteArray &previousStamp, const KBookmark &bookmark);
+    void _k_placeChanged(const QString &file, const QByteArray &previousStamp, const QByteArray &stamp, const QString &address);
+    void bookmarksFileChanged();
+    bool patchBookmarks(const QString &address);
+
+    // Edits are shown right away, and written to disk once there were none
+    // for a moment. A null bookmark stands for anything but a single edit.
+    QTimer saveTimer;
+    bool savePending = false;
+    QVector<KBookmark> unsavedBookmarks;
+    void scheduleSave(const KBookmark &changed);
+    void flush();
+    void restoreUnsavedBookmarks();
+
+    // Adds the default places to a new file, and updates old ones
+    void migrateBookmarks(const QString &file);
+
+    void reloadAndSignal(const KBookmark &changed = KBookmark());
+    QVector<int> loadBookmarkRows();
     int findNearestPosition(int source, int target);
 
     QVector<QString> tags;
@@ -205,9 +284,9 @@ public:
     KCoreDirLister *tagsLister;
 
     void initDeviceList();
-    void deviceAdded(const QString &udi);
-    void deviceRemoved(const QString &udi);
-    void itemChanged(const QString &udi);
+    void mountsChanged(const QStringList &added, const QStringList &removed, const QStringList &changed);
+    void deviceStatusChanged(const QString &mountPoint);
+    void itemChanged(quint64 placeId);
     void reloadBookmarks();
 
 private:
@@ -232,24 +311,51 @@ static inline QString versionKey()
     return QStringLiteral("kde_places_version");
 }
 
-SFilePlacesModel::SFilePlacesModel(const QString &alternativeApplicationName, QObject *parent)
-    : QAbstractItemModel(parent)
-    , d(new SFilePlacesModelPrivate(this))
+// Increase this version number and use the following logic to handle the update process for existing installations.
+static const int s_currentVersion = 4;
+
+static bool withRecentlyUsed()
 {
-    const QString file = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QLatin1String("/user-places.xbel");
-    d->bookmarkManager = KBookmarkManager::managerForExternalFile(file);
-    d->alternativeApplicationName = alternativeApplicationName;
+    return qEnvironmentVariableIsSet("KDE_FULL_SESSION") && KProtocolInfo::isKnownProtocol(QStringLiteral("recentlyused"));
+}
+
+static QString migrationStampFile()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QLatin1String("/user-places.xbel.migrated");
+}
+
+// Every save replaces the file, so every version has an inode and a
+// modification time of its own. That's the same for every process, and
+// takes a stat() instead of reading and hashing the whole file.
+static QByteArray fileStamp(const QString &file)
+{
+    struct stat buff;
+    if (stat(QFile::encodeName(file).constData(), &buff) != 0) {
+        return QByteArray();
+    }
+    return QByteArray::number(quint64(buff.st_dev)) + ':' + QByteArray::number(quint64(buff.st_ino)) + ':' + QByteArray::number(qint64(buff.st_size)) + ':'
+        + QByteArray::number(qint64(buff.st_mtim.tv_sec)) + '.' + QByteArray::number(qint64(buff.st_mtim.tv_nsec));
+}
+
+// Everything migrateBookmarks() depends on. The version of the file is in
+// there too, so an older copy put back in its place is migrated again.
+// Any other save changes it as well, which only costs one more check of
+// what's already there.
+static QByteArray migrationStamp(const QString &file, bool fileIndexingEnabled)
+{
+    return QByteArray::number(s_currentVersion) + ' ' + QByteArray::number(withRecentlyUsed()) + ' ' + QByteArray::number(fileIndexingEnabled) + ' '
+        + fileStamp(file) + ' ' + QFile::encodeName(file);
+}
 
+void SFilePlacesModelPrivate::migrateBookmarks(const QString &file)
+{
     // Let's put some places in there if it's empty.
-    KBookmarkGroup root = d->bookmarkManager->root();
+    KBookmarkGroup root = bookmarkManager->root();
 
     const auto setDefaultMetadataItemForGroup = [&root](SFilePlacesModel::GroupType type) {
         root.setMetaDataItem(stateNameForGroupType(type), QStringLiteral("false"));
     };
 
-    // Increase this version number and use the following logic to handle the update process for existing installations.
-    static const int s_currentVersion = 4;
-
     const bool newFile = root.first().isNull() || !QFile::exists(file);
     const int fileVersion = root.metaDataItem(versionKey()).toInt();
 
@@ -266,7 +372,7 @@ SFilePlacesModel::SFilePlacesModel(const QString &alternativeApplicationName, QO
                               const QString &iconName,
                               const KBookmark &after) {
                 if (!seenUrls.contains(url)) {
-                    return SFilePlacesItem::createSystemBookmark(d->bookmarkManager, translationContext, untranslatedLabel, url, iconName, after);
+                    return SFilePlacesItem::createSystemBookmark(bookmarkManager, translationContext, untranslatedLabel, url, iconName, after);
                 }
                 return KBookmark();
             };
@@ -310,7 +416,7 @@ SFilePlacesModel::SFilePlacesModel(const QString &alternativeApplicationName, QO
         }
 
         if (!newFile && fileVersion < 3) {
-            KBookmarkGroup root = d->bookmarkManager->root();
+            KBookmarkGroup root = bookmarkManager->root();
             KBookmark bItem = root.first();
             while (!bItem.isNull()) {
                 KBookmark nextbItem = root.next(bItem);
@@ -345,7 +451,7 @@ SFilePlacesModel::SFilePlacesModel(const QString &alternativeApplicationName, QO
         }
         if (fileVersion < 4) {
             auto findSystemBookmark = [this](const QString &untranslatedText) {
-                KBookmarkGroup root = d->bookmarkManager->root();
+                KBookmarkGroup root = bookmarkManager->root();
                 KBookmark bItem = root.first();
                 while (!bItem.isNull()) {
                     const bool isSystemItem = bItem.metaDataItem(QStringLiteral("isSystemItem")) == QLatin1String("true");
@@ -388,92 +494,130 @@ SFilePlacesModel::SFilePlacesModel(const QString &alternativeApplicationName, QO
         }
 
         if (newFile) {
-            setDefaultMetadataItemForGroup(PlacesType);
-            setDefaultMetadataItemForGroup(RemoteType);
-            setDefaultMetadataItemForGroup(DevicesType);
-            setDefaultMetadataItemForGroup(RemovableDevicesType);
-            setDefaultMetadataItemForGroup(TagsType);
+            setDefaultMetadataItemForGroup(SFilePlacesModel::PlacesType);
+            setDefaultMetadataItemForGroup(SFilePlacesModel::RemoteType);
+            setDefaultMetadataItemForGroup(SFilePlacesModel::DevicesType);
+            setDefaultMetadataItemForGroup(SFilePlacesModel::RemovableDevicesType);
+            setDefaultMetadataItemForGroup(SFilePlacesModel::TagsType);
         }
 
         // Force bookmarks to be saved. If on open/save dialog and the bookmarks are not saved, QFile::exists
         // will always return false, which opening/closing all the time the open/save dialog would cause the
         // bookmarks to be added once each time, having lots of times each bookmark. (ereslibre)
-        d->bookmarkManager->saveAs(file);
+        bookmarkManager->saveAs(file);
     }
 
     // Add a Recently Used entry if available (it comes from kio-extras)
-    if (qEnvironmentVariableIsSet("KDE_FULL_SESSION") && KProtocolInfo::isKnownProtocol(QStringLiteral("recentlyused"))
-        && root.metaDataItem(QStringLiteral("withRecentlyUsed")) != QLatin1String("true")) {
+    if (withRecentlyUsed() && root.metaDataItem(QStringLiteral("withRecentlyUsed")) != QLatin1String("true")) {
         root.setMetaDataItem(QStringLiteral("withRecentlyUsed"), QStringLiteral("true"));
 
-        KBookmark recentFilesBookmark = SFilePlacesItem::createSystemBookmark(d->bookmarkManager,
+        KBookmark recentFilesBookmark = SFilePlacesItem::createSystemBookmark(bookmarkManager,
                                                                               I18NC_NOOP("KFile System Bookmarks", "Recent Files"),
                                                                               QUrl(QStringLiteral("recentlyused:/files")),
                                                                               QStringLiteral("document-open-recent"));
 
-        KBookmark recentDirectoriesBookmark = SFilePlacesItem::createSystemBookmark(d->bookmarkManager,
+        KBookmark recentDirectoriesBookmark = SFilePlacesItem::createSystemBookmark(bookmarkManager,
                                                                                     I18NC_NOOP("KFile System Bookmarks", "Recent Locations"),
                                                                                     QUrl(QStringLiteral("recentlyused:/locations")),
                                                                                     QStringLiteral("folder-open-recent"));
 
-        setDefaultMetadataItemForGroup(RecentlySavedType);
+        setDefaultMetadataItemForGroup(SFilePlacesModel::RecentlySavedType);
 
         // Move The recently used bookmarks below the trash, making it the first element in the Recent group
-        KBookmark trashBookmark = bookmarkForUrl(QUrl(QStringLiteral("trash:/")));
+        KBookmark trashBookmark = q->bookmarkForUrl(QUrl(QStringLiteral("trash:/")));
         if (!trashBookmark.isNull()) {
             root.moveBookmark(recentFilesBookmark, trashBookmark);
             root.moveBookmark(recentDirectoriesBookmark, recentFilesBookmark);
         }
 
-        d->bookmarkManager->save();
+        bookmarkManager->save();
     }
 
     // if baloo is enabled, add new urls even if the bookmark file is not empty
-    if (d->fileIndexingEnabled && root.metaDataItem(QStringLiteral("withBaloo")) != QLatin1String("true")) {
+    if (fileIndexingEnabled && root.metaDataItem(QStringLiteral("withBaloo")) != QLatin1String("true")) {
         root.setMetaDataItem(QStringLiteral("withBaloo"), QStringLiteral("true"));
 
         // don't add by default "Modified Today" and "Modified Yesterday" when recentlyused:/ is present
         if (root.metaDataItem(QStringLiteral("withRecentlyUsed")) != QLatin1String("true")) {
-            SFilePlacesItem::createSystemBookmark(d->bookmarkManager,
+            SFilePlacesItem::createSystemBookmark(bookmarkManager,
                                                   I18NC_NOOP("KFile System Bookmarks", "Modified Today"),
                                                   QUrl(QStringLiteral("timeline:/today")),
                                                   QStringLiteral("go-jump-today"));
-            SFilePlacesItem::createSystemBookmark(d->bookmarkManager,
+            SFilePlacesItem::createSystemBookmark(bookmarkManager,
                                                   I18NC_NOOP("KFile System Bookmarks", "Modified Yesterday"),
                                                   QUrl(QStringLiteral("timeline:/yesterday")),
                                                   QStringLiteral("view-calendar-day"));
         }
 
-        SFilePlacesItem::createSystemBookmark(d->bookmarkManager,
+        SFilePlacesItem::createSystemBookmark(bookmarkManager,
                                               I18NC_NOOP("KFile System Bookmarks", "Documents"),
                                               QUrl(QStringLiteral("search:/documents")),
                                               QStringLiteral("folder-text"));
-        SFilePlacesItem::createSystemBookmark(d->bookmarkManager,
+        SFilePlacesItem::createSystemBookmark(bookmarkManager,
                                               I18NC_NOOP("KFile System Bookmarks", "Images"),
                                               QUrl(QStringLiteral("search:/images")),
                                               QStringLiteral("folder-images"));
-        SFilePlacesItem::createSystemBookmark(d->bookmarkManager,
+        SFilePlacesItem::createSystemBookmark(bookmarkManager,
                                               I18NC_NOOP("KFile System Bookmarks", "Audio"),
                                               QUrl(QStringLiteral("search:/audio")),
                                               QStringLiteral("folder-sound"));
-        SFilePlacesItem::createSystemBookmark(d->bookmarkManager,
+        SFilePlacesItem::createSystemBookmark(bookmarkManager,
                                               I18NC_NOOP("KFile System Bookmarks", "Videos"),
                                               QUrl(QStringLiteral("search:/videos")),
                                               QStringLiteral("folder-videos"));
 
-        setDefaultMetadataItemForGroup(SearchForType);
-        setDefaultMetadataItemForGroup(RecentlySavedType);
+        setDefaultMetadataItemForGroup(SFilePlacesModel::SearchForType);
+        setDefaultMetadataItemForGroup(SFilePlacesModel::RecentlySavedType);
 
-        d->bookmarkManager->save();
+        bookmarkManager->save();
+    }
+}
+
+SFilePlacesModel::SFilePlacesModel(const QString &alternativeApplicationName, QObject *parent)
+    : QAbstractItemModel(parent)
+    , d(new SFilePlacesModelPrivate(this))
+{
+    const QString file = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QLatin1String("/user-places.xbel");
+    d->bookmarkManager = KBookmarkManager::managerForExternalFile(file);
+    d->alternativeApplicationName = alternativeApplicationName;
+
+    // Setting up the places, and bringing them up to date, only has to be
+    // done once, not for every dialog
+    QFile stampFile(migrationStampFile());
+    if (d->bookmarkManager->root().first().isNull() || !stampFile.open(QIODevice::ReadOnly)
+        || stampFile.readAll() != migrationStamp(file, d->fileIndexingEnabled)) {
+        stampFile.close();
+        d->migrateBookmarks(file);
+
+        // With the file as the migration left it
+        QDir().mkpath(QFileInfo(stampFile).path());
+        if (stampFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            stampFile.write(migrationStamp(file, d->fileIndexingEnabled));
+        }
     }
 
     connect(d->bookmarkManager, &KBookmarkManager::changed, this, [this]() {
-        d->reloadBookmarks();
+        d->bookmarksFileChanged();
     });
     connect(d->bookmarkManager, &KBookmarkManager::bookmarksChanged, this, [this]() {
-        d->reloadBookmarks();
+        d->bookmarksFileChanged();
+    });
+    QDBusConnection::sessionBus().connect(QString(),
+                                          QStringLiteral("/SFilePlacesModel"),
+                                          QStringLiteral("org.kde.SFilePlacesModel"),
+                                          QStringLiteral("placeChanged"),
+                                          this,
+                                          SLOT(_k_placeChanged(QString,QByteArray,QByteArray,QString)));
+
+    // Dragging places around, or hiding a few, is one save
+    d->saveTimer.setSingleShot(true);
+    d->saveTimer.setInterval(500);
+    connect(&d->saveTimer, &QTimer::timeout, this, [this]() {
+        d->flush();
     });
 
+    d->bookmarksFile = file;
+    d->bookmarksStamp = d->readBookmarksStamp();
     d->reloadBookmarks();
     QTimer::singleShot(0, this, [this]() {
         d->initDeviceList();
@@ -485,7 +629,10 @@ SFilePlacesModel::SFilePlacesModel(QObject *parent)
 {
 }
 
-SFilePlacesModel::~SFilePlacesModel() = default;
+SFilePlacesModel::~SFilePlacesModel()
+{
+    d->flush();
+}
 
 QUrl SFilePlacesModel::url(const QModelIndex &index) const
 {
@@ -515,8 +662,10 @@ bool SFilePlacesModel::isHidden(const QModelIndex &index) const
 
 bool SFilePlacesModel::isGroupHidden(const GroupType type) const
 {
-    const QString hidden = d->bookmarkManager->root().metaDataItem(stateNameForGroupType(type));
-    return hidden == QLatin1String("true");
+    if (type == UnknownType) {
+        return false;
+    }
+    return d->groupHiddenMask() & (1u << type);
 }
 
 bool SFilePlacesModel::isGroupHidden(const QModelIndex &index) const
@@ -540,10 +689,10 @@ bool SFilePlacesModel::isDevice(const QModelIndex &index) const
     return item->isDevice();
 }
 
-QStorageInfo SFilePlacesModel::deviceForIndex(const QModelIndex &index) const
+SMountWatcher::Mount SFilePlacesModel::deviceForIndex(const QModelIndex &index) const
 {
     if (!index.isValid()) {
-        return QStorageInfo();
+        return SMountWatcher::Mount();
     }
 
     SFilePlacesItem *item = static_cast<SFilePlacesItem *>(index.internalPointer());
@@ -551,7 +700,7 @@ QStorageInfo SFilePlacesModel::deviceForIndex(const QModelIndex &index) const
     if (item->isDevice()) {
         return item->device();
     } else {
-        return QStorageInfo();
+        return SMountWatcher::Mount();
     }
 }
 
@@ -644,127 +793,276 @@ int SFilePlacesModel::columnCount(const QModelIndex &parent) const
 
 QModelIndex SFilePlacesModel::closestItem(const QUrl &url) const
 {
-    int foundRow = -1;
-    int maxLength = 0;
+    SFilePlacesItem *foundItem = nullptr;
 
     // Search the item which is equal to the URL or at least is a parent URL.
     // If there are more than one possible item URL candidates, choose the item
-    // which covers the bigger range of the URL.
-    for (int row = 0; row < d->items.size(); ++row) {
-        SFilePlacesItem *item = d->items[row];
-
-        if (item->isHidden() || isGroupHidden(item->groupType())) {
-            continue;
-        }
+    // which covers the bigger range of the URL, which is the deepest one.
+    d->urlTrie.findParents(url, [this, &url, &foundItem](const QVector<SFilePlacesItem *> &candidates, bool exact) {
+        int foundRow = -1;
+        int maxLength = 0;
+        for (SFilePlacesItem *item : candidates) {
+            if (item->isHidden() || isGroupHidden(item->groupType())) {
+                continue;
+            }
 
-        const QUrl itemUrl(item->data(UrlRole).toUrl());
+            const QUrl itemUrl(item->data(UrlRole).toUrl());
+            if (exact && !itemUrl.matches(url, QUrl::StripTrailingSlash)) {
+                continue;
+            }
 
-        if (itemUrl.matches(url, QUrl::StripTrailingSlash) || itemUrl.isParentOf(url)) {
+            // Same path, so only the query or a trailing slash can differ
             const int length = itemUrl.toString().length();
-            if (length > maxLength) {
+            const int row = d->rowOf(item);
+            if (length > maxLength || (length == maxLength && row < foundRow)) {
+                foundItem = item;
                 foundRow = row;
                 maxLength = length;
             }
         }
-    }
+        return foundItem != nullptr;
+    });
 
-    if (foundRow == -1) {
+    if (!foundItem) {
         return QModelIndex();
     } else {
-        return createIndex(foundRow, 0, d->items[foundRow]);
+        return createIndex(d->rowOf(foundItem), 0, foundItem);
+    }
+}
+
+void SFilePlacesModelPrivate::trackItem(const SFilePlacesItem *item, int delta)
+{
+    const SFilePlacesModel::GroupType type = item->groupType();
+    groupItemCounts[type] += delta;
+    if (item->isHidden()) {
+        groupHiddenPlaceCounts[type] += delta;
     }
+    visibleRowsValid = false;
+}
+
+int SFilePlacesModelPrivate::rowOf(const SFilePlacesItem *item) const
+{
+    updateItemLookup();
+    return itemRows.value(item, -1);
+}
+
+QList<SFilePlacesItem *> SFilePlacesModelPrivate::itemsWithId(quint64 placeId) const
+{
+    updateItemLookup();
+    return itemsById.values(placeId);
+}
+
+void SFilePlacesModelPrivate::updateItemLookup() const
+{
+    if (itemRowsValid) {
+        return;
+    }
+
+    itemRows.clear();
+    itemsById.clear();
+    itemRows.reserve(items.count());
+    itemsById.reserve(items.count());
+    for (int row = 0; row < items.count(); ++row) {
+        itemRows.insert(items.at(row), row);
+        itemsById.insert(items.at(row)->placeId(), items.at(row));
+    }
+    itemRowsValid = true;
 }
 
 void SFilePlacesModelPrivate::initDeviceList()
 {
-    availableDevices.clear();
-    for (const QStorageInfo &info : QStorageInfo::mountedVolumes()) {
-        //availableDevices.append(info.rootPath());
+    SMountWatcher *watcher = SMountWatcher::self();
+    QObject::connect(watcher, &SMountWatcher::mountsChanged, q, [this](const QStringList &added, const QStringList &removed, const QStringList &changed) {
+        mountsChanged(added, removed, changed);
+    });
+
+    QObject::connect(SDeviceStatus::self(), &SDeviceStatus::statusChanged, q, [this](const QString &mountPoint) {
+        deviceStatusChanged(mountPoint);
+    });
+
+    const QStringList udis = watcher->udis();
+    availableDevices = QVector<QString>(udis.begin(), udis.end());
+
+    reloadBookmarks();
+}
+
+void SFilePlacesModelPrivate::mountsChanged(const QStringList &added, const QStringList &removed, const QStringList &changed)
+{
+    // A device that's still there but mounted elsewhere, or got a new
+    // label, keeps its row
+    for (const QString &udi : changed) {
+        const quint64 placeId = SFilePlacesIndex::devicePlaceId(udi);
+        const QList<SFilePlacesItem *> deviceItems = itemsWithId(placeId);
+        for (SFilePlacesItem *item : deviceItems) {
+            trackItem(item, -1);
+            item->refreshDevice();
+            trackItem(item, 1);
+        }
+        itemChanged(placeId);
+    }
+
+    if (added.isEmpty() && removed.isEmpty()) {
+        return;
     }
 
+    for (const QString &udi : removed) {
+        availableDevices.removeAll(udi);
+    }
+    for (const QString &udi : added) {
+        if (!availableDevices.contains(udi)) {
+            availableDevices.append(udi);
+        }
+    }
+
+    // Once for the whole batch, plugging in a disk mounts all its partitions
     reloadBookmarks();
 }
 
-void SFilePlacesModelPrivate::itemChanged(const QString &id)
+void SFilePlacesModelPrivate::deviceStatusChanged(const QString &mountPoint)
 {
+    const QUrl url = QUrl::fromLocalFile(mountPoint);
     for (int row = 0; row < items.size(); ++row) {
-        if (items.at(row)->id() == id) {
-            QModelIndex index = q->index(row, 0);
-            Q_EMIT q->dataChanged(index, index);
+        SFilePlacesItem *item = items.at(row);
+        if (item->isDevice() && item->data(SFilePlacesModel::UrlRole).toUrl() == url) {
+            const QModelIndex index = q->index(row, 0);
+            Q_EMIT q->dataChanged(index, index, {SFilePlacesModel::SetupNeededRole, SFilePlacesModel::CapacityBarRecommendedRole, SFilePlacesModel::CapacityRole});
         }
     }
 }
 
-void SFilePlacesModelPrivate::reloadBookmarks()
+void SFilePlacesModelPrivate::itemChanged(quint64 placeId)
+{
+    const QList<SFilePlacesItem *> changedItems = itemsWithId(placeId);
+    for (SFilePlacesItem *item : changedItems) {
+        // A device might have been mounted somewhere else
+        urlTrie.insert(item, item->data(SFilePlacesModel::UrlRole).toUrl());
+
+        const QModelIndex index = q->index(rowOf(item), 0);
+        Q_EMIT q->dataChanged(index, index);
+    }
+}
+
+quint32 SFilePlacesModelPrivate::groupHiddenMask() const
 {
-    QList<SFilePlacesItem *> currentItems = loadBookmarkList();
+    if (groupHiddenBitsValid) {
+        return groupHiddenBits;
+    }
 
-    QList<SFilePlacesItem *>::Iterator it_i = items.begin();
-    QList<SFilePlacesItem *>::Iterator it_c = currentItems.begin();
+    const KBookmarkGroup root = bookmarkManager->root();
+    groupHiddenBits = 0;
+    for (SFilePlacesModel::GroupType type : {SFilePlacesModel::PlacesType,
+                                             SFilePlacesModel::RemoteType,
+                                             SFilePlacesModel::RecentlySavedType,
+                                             SFilePlacesModel::SearchForType,
+                                             SFilePlacesModel::DevicesType,
+                                             SFilePlacesModel::RemovableDevicesType,
+                                             SFilePlacesModel::TagsType}) {
+        if (root.metaDataItem(stateNameForGroupType(type)) == QLatin1String("true")) {
+            groupHiddenBits |= 1u << type;
+        }
+    }
+    groupHiddenBitsValid = true;
 
-    QList<SFilePlacesItem *>::Iterator end_i = items.end();
-    QList<SFilePlacesItem *>::Iterator end_c = currentItems.end();
+    return groupHiddenBits;
+}
 
-    while (it_i != end_i || it_c != end_c) {
-        if (it_i == end_i && it_c != end_c) {
-            int row = items.count();
+void SFilePlacesModelPrivate::setGroupHiddenBit(SFilePlacesModel::GroupType type, bool hidden)
+{
+    groupHiddenMask();
+    if (hidden) {
+        groupHiddenBits |= 1u << type;
+    } else {
+        groupHiddenBits &= ~(1u << type);
+    }
+}
 
-            q->beginInsertRows(QModelIndex(), row, row);
-            it_i = items.insert(it_i, *it_c);
-            ++it_i;
-            it_c = currentItems.erase(it_c);
+void SFilePlacesModelPrivate::reloadBookmarks()
+{
+    // Might have been changed by another process
+    groupHiddenBitsValid = false;
+    visibleRowsValid = false;
 
-            end_i = items.end();
-            end_c = currentItems.end();
-            q->endInsertRows();
+    const QVector<int> rows = loadBookmarkRows();
+    const std::shared_ptr<SFilePlacesIndex> index = bookmarksIndex;
 
-        } else if (it_i != end_i && it_c == end_c) {
-            int row = items.indexOf(*it_i);
+    QVector<quint64> oldIds;
+    oldIds.reserve(items.count());
+    for (const SFilePlacesItem *item : std::as_const(items)) {
+        oldIds.append(item->placeId());
+    }
+    QVector<quint64> newIds;
+    newIds.reserve(rows.count());
+    for (int row : rows) {
+        newIds.append(index->placeIds.at(row));
+    }
 
-            q->beginRemoveRows(QModelIndex(), row, row);
-            delete *it_i;
-            it_i = items.erase(it_i);
+    const SFilePlacesDiff::Plan plan = SFilePlacesDiff::diff(oldIds, newIds);
 
-            end_i = items.end();
-            end_c = currentItems.end();
-            q->endRemoveRows();
+    for (const SFilePlacesDiff::Range &removal : plan.removals) {
+        q->beginRemoveRows(QModelIndex(), removal.first, removal.last);
+        for (int i = removal.first; i <= removal.last; ++i) {
+            urlTrie.remove(items.at(i));
+            trackItem(items.at(i), -1);
+        }
+        qDeleteAll(items.begin() + removal.first, items.begin() + removal.last + 1);
+        items.erase(items.begin() + removal.first, items.begin() + removal.last + 1);
+        itemRowsValid = false;
+        q->endRemoveRows();
+    }
 
-        } else if ((*it_i)->id() == (*it_c)->id()) {
-            bool shouldEmit = !((*it_i)->bookmark() == (*it_c)->bookmark());
-            (*it_i)->setBookmark((*it_c)->bookmark());
-            if (shouldEmit) {
-                int row = items.indexOf(*it_i);
-                QModelIndex idx = q->index(row, 0);
-                Q_EMIT q->dataChanged(idx, idx);
-            }
-            ++it_i;
-            ++it_c;
-        } else {
-            int row = items.indexOf(*it_i);
+    for (const SFilePlacesDiff::Range &move : plan.moves) {
+        q->beginMoveRows(QModelIndex(), move.first, move.last, QModelIndex(), move.destination);
+        SFilePlacesDiff::moveRange(items, move);
+        itemRowsValid = false;
+        visibleRowsValid = false;
+        q->endMoveRows();
+    }
 
-            if (it_i + 1 != end_i && (*(it_i + 1))->id() == (*it_c)->id()) { // if the next one matches, it's a remove
-                q->beginRemoveRows(QModelIndex(), row, row);
-                delete *it_i;
-                it_i = items.erase(it_i);
+    // Now the order matches, take over the new data
+    QVector<bool> changed(items.count(), false);
+    for (int row = 0; row < items.count(); ++row) {
+        SFilePlacesItem *item = items.at(row);
+        const int indexRow = rows.at(plan.targets.at(row));
+        changed[row] = !item->index().rowEquals(item->indexRow(), *index, indexRow);
+        if (changed.at(row)) {
+            trackItem(item, -1);
+        }
+        item->setIndexRow(index, indexRow);
+        if (changed.at(row)) {
+            trackItem(item, 1);
+            urlTrie.insert(item, item->data(SFilePlacesModel::UrlRole).toUrl());
+        }
+    }
 
-                end_i = items.end();
-                end_c = currentItems.end();
-                q->endRemoveRows();
-            } else {
-                q->beginInsertRows(QModelIndex(), row, row);
-                it_i = items.insert(it_i, *it_c);
-                ++it_i;
-                it_c = currentItems.erase(it_c);
-
-                end_i = items.end();
-                end_c = currentItems.end();
-                q->endInsertRows();
-            }
+    // And add what's new, only those need new items
+    for (const SFilePlacesDiff::Range &insertion : plan.insertions) {
+        q->beginInsertRows(QModelIndex(), insertion.first, insertion.last);
+        for (int row = insertion.first; row <= insertion.last; ++row) {
+            SFilePlacesItem *item = new SFilePlacesItem(index, rows.at(row), q);
+            QObject::connect(item, &SFilePlacesItem::itemChanged, q, [this](quint64 placeId) {
+                itemChanged(placeId);
+            });
+            urlTrie.insert(item, item->data(SFilePlacesModel::UrlRole).toUrl());
+            trackItem(item, 1);
+            items.insert(row, item);
+            changed.insert(row, false);
         }
+        itemRowsValid = false;
+        q->endInsertRows();
     }
 
-    qDeleteAll(currentItems);
-    currentItems.clear();
+    for (int first = 0; first < changed.count(); ++first) {
+        if (!changed.at(first)) {
+            continue;
+        }
+
+        int last = first;
+        while (last + 1 < changed.count() && changed.at(last + 1)) {
+            last++;
+        }
+        Q_EMIT q->dataChanged(q->index(first, 0), q->index(last, 0));
+        first = last;
+    }
 
     Q_EMIT q->reloaded();
 }
@@ -775,100 +1073,103 @@ bool SFilePlacesModelPrivate::isBalooUrl(const QUrl &url) const
     return ((scheme == QLatin1String("timeline")) || (scheme == QLatin1String("search")));
 }
 
-QList<SFilePlacesItem *> SFilePlacesModelPrivate::loadBookmarkList()
+QVector<int> SFilePlacesModelPrivate::loadBookmarkRows()
 {
-    QList<SFilePlacesItem *> items;
-
-    KBookmarkGroup root = bookmarkManager->root();
-    KBookmark bookmark = root.first();
+    // Everything is read from the DOM once here, the items serve all their
+    // data from this
+    const auto index = std::make_shared<SFilePlacesIndex>(SFilePlacesIndex::fromBookmarks(bookmarkManager->root()));
+    bookmarksIndex = index;
+    bookmarksDocument = bookmarkManager->internalDocument();
     QVector<QString> devices = availableDevices;
     QVector<QString> tagsList = tags;
 
-    while (!bookmark.isNull()) {
-        const QString udi = bookmark.metaDataItem(QStringLiteral("UDI"));
-        const QUrl url = bookmark.url();
-        const QString tag = bookmark.metaDataItem(QStringLiteral("tag"));
-        if (!udi.isEmpty() || url.isValid()) {
-            QString appName = bookmark.metaDataItem(QStringLiteral("OnlyInApp"));
-
-            // If it's not a tag it's a device
-            if (tag.isEmpty()) {
-                auto it = std::find(devices.begin(), devices.end(), udi);
-                bool deviceAvailable = (it != devices.end());
-                if (deviceAvailable) {
-                    devices.erase(it);
-                }
+    // The rows to show, with their groups. Bookmarks added by hand get their
+    // ids here, and ones from before there were place ids get those saved,
+    // so they're only made up once.
+    QVector<QPair<SFilePlacesModel::GroupType, int>> rows;
+    const auto addRow = [this, &rows, &index](int row) {
+        SMountWatcher::Mount mount;
+        if (index->isDevice(row)) {
+            mount = SMountWatcher::self()->mount(index->udis.at(row));
+        } else if (index->ids.at(row).isEmpty()) {
+            index->setId(row, SFilePlacesItem::generateNewId());
+            scheduleSave(index->bookmarks.at(row));
+        } else if (index->flags.at(row) & SFilePlacesIndex::PlaceIdMissingFlag) {
+            index->storePlaceId(row);
+            scheduleSave(index->bookmarks.at(row));
+        }
+        rows.append(qMakePair(SFilePlacesItem::groupType(*index, row, mount), row));
+    };
 
-                bool allowedHere =
-                    appName.isEmpty() || ((appName == QCoreApplication::instance()->applicationName()) || (appName == alternativeApplicationName));
-                bool isSupportedUrl = isBalooUrl(url) ? fileIndexingEnabled : true;
-                bool isSupportedScheme = supportedSchemes.isEmpty() || supportedSchemes.contains(url.scheme());
-
-                SFilePlacesItem *item = nullptr;
-                if (deviceAvailable) {
-                    item = new SFilePlacesItem(bookmarkManager, bookmark.address(), udi, q);
-                    if (!item->hasSupportedScheme(supportedSchemes)) {
-                        delete item;
-                        item = nullptr;
-                    }
-                } else if (isSupportedScheme && isSupportedUrl && udi.isEmpty() && allowedHere) {
-                    // TODO: Update bookmark internal element
-                    item = new SFilePlacesItem(bookmarkManager, bookmark.address(), QString(), q);
-                }
+    // Network shares are mounted too, so all devices are local files
+    const bool devicesSupported = supportedSchemes.isEmpty() || supportedSchemes.contains(QLatin1String("file"));
 
-                if (item) {
-                    QObject::connect(item, &SFilePlacesItem::itemChanged, q, [this](const QString &id) {
-                        itemChanged(id);
-                    });
+    const int count = index->count();
+    for (int row = 0; row < count; ++row) {
+        const QString &udi = index->udis.at(row);
+        const QUrl &url = index->urls.at(row);
+        const QString &tag = index->tags.at(row);
+        if (udi.isEmpty() && !url.isValid()) {
+            continue;
+        }
 
-                    items << item;
-                }
-            } else {
-                auto it = std::find(tagsList.begin(), tagsList.end(), tag);
-                if (it != tagsList.end()) {
-                    tagsList.removeAll(tag);
-                    SFilePlacesItem *item = new SFilePlacesItem(bookmarkManager, bookmark.address(), QString(), q);
-                    items << item;
-                    QObject::connect(item, &SFilePlacesItem::itemChanged, q, [this](const QString &id) {
-                        itemChanged(id);
-                    });
+        // If it's not a tag it's a device
+        if (tag.isEmpty()) {
+            const QString &appName = index->appNames.at(row);
+
+            auto it = std::find(devices.begin(), devices.end(), udi);
+            bool deviceAvailable = (it != devices.end());
+            if (deviceAvailable) {
+                devices.erase(it);
+            }
+
+            bool allowedHere =
+                appName.isEmpty() || ((appName == QCoreApplication::instance()->applicationName()) || (appName == alternativeApplicationName));
+            bool isSupportedUrl = isBalooUrl(url) ? fileIndexingEnabled : true;
+            bool isSupportedScheme = supportedSchemes.isEmpty() || supportedSchemes.contains(url.scheme());
+
+            if (deviceAvailable) {
+                if (devicesSupported) {
+                    addRow(row);
                 }
+            } else if (isSupportedScheme && isSupportedUrl && udi.isEmpty() && allowedHere) {
+                addRow(row);
+            }
+        } else {
+            auto it = std::find(tagsList.begin(), tagsList.end(), tag);
+            if (it != tagsList.end()) {
+                tagsList.removeAll(tag);
+                addRow(row);
             }
         }
-
-        bookmark = root.next(bookmark);
     }
 
     // Add bookmarks for the remaining devices, they were previously unknown
     for (const QString &udi : std::as_const(devices)) {
-        bookmark = SFilePlacesItem::createDeviceBookmark(bookmarkManager, udi);
+        const KBookmark bookmark = SFilePlacesItem::createDeviceBookmark(bookmarkManager, udi);
         if (!bookmark.isNull()) {
-            SFilePlacesItem *item = new SFilePlacesItem(bookmarkManager, bookmark.address(), udi, q);
-            QObject::connect(item, &SFilePlacesItem::itemChanged, q, [this](const QString &id) {
-                itemChanged(id);
-            });
-            // TODO: Update bookmark internal element
-            items << item;
+            addRow(index->append(bookmark));
         }
     }
 
     for (const QString &tag : tagsList) {
-        bookmark = SFilePlacesItem::createTagBookmark(bookmarkManager, tag);
+        const KBookmark bookmark = SFilePlacesItem::createTagBookmark(bookmarkManager, tag);
         if (!bookmark.isNull()) {
-            SFilePlacesItem *item = new SFilePlacesItem(bookmarkManager, bookmark.address(), tag, q);
-            QObject::connect(item, &SFilePlacesItem::itemChanged, q, [this](const QString &id) {
-                itemChanged(id);
-            });
-            items << item;
+            addRow(index->append(bookmark));
         }
     }
 
     // return a sorted list based on groups
-    std::stable_sort(items.begin(), items.end(), [](SFilePlacesItem *itemA, SFilePlacesItem *itemB) {
-        return (itemA->groupType() < itemB->groupType());
+    std::stable_sort(rows.begin(), rows.end(), [](const QPair<SFilePlacesModel::GroupType, int> &rowA, const QPair<SFilePlacesModel::GroupType, int> &rowB) {
+        return rowA.first < rowB.first;
     });
 
-    return items;
+    QVector<int> result;
+    result.reserve(rows.count());
+    for (const auto &row : std::as_const(rows)) {
+        result.append(row.second);
+    }
+    return result;
 }
 
 int SFilePlacesModelPrivate::findNearestPosition(int source, int target)
@@ -906,9 +1207,207 @@ int SFilePlacesModelPrivate::findNearestPosition(int source, int target)
     return target;
 }
 
-void SFilePlacesModelPrivate::reloadAndSignal()
+void SFilePlacesModelPrivate::reloadAndSignal(const KBookmark &changed)
+{
+    reloadBookmarks();
+    scheduleSave(changed);
+}
+
+void SFilePlacesModelPrivate::scheduleSave(const KBookmark &changed)
+{
+    if (!unsavedBookmarks.contains(changed)) {
+        unsavedBookmarks.append(changed);
+    }
+    savePending = true;
+    saveTimer.start();
+}
+
+void SFilePlacesModelPrivate::flush()
+{
+    saveTimer.stop();
+    if (!savePending) {
+        return;
+    }
+    savePending = false;
+
+    const QByteArray previousStamp = bookmarksStamp;
+
+    // KBookmarkManager writes through QSaveFile, readers never see half a
+    // file. Not through emitChanged(), see announceChange().
+    savingBookmarks = true;
+    bookmarkManager->save(false);
+    savingBookmarks = false;
+
+    bookmarksStamp = readBookmarksStamp();
+    if (bookmarksStamp != previousStamp) {
+        announceChange(previousStamp, unsavedBookmarks.count() == 1 ? unsavedBookmarks.first() : KBookmark());
+    }
+    unsavedBookmarks.clear();
+}
+
+void SFilePlacesModelPrivate::restoreUnsavedBookmarks()
+{
+    // The bookmarks of the last reload still point into the document we
+    // edited, that one is only dropped by KBookmarkManager
+    QDomDocument document = bookmarkManager->internalDocument();
+    const QDomElement edited = bookmarksDocument.documentElement();
+    const QDomElement current = document.documentElement();
+    if (edited.isNull() || current.isNull()) {
+        return;
+    }
+
+    // Places were added, removed or moved, only the whole list has that
+    if (unsavedBookmarks.contains(KBookmark())) {
+        document.replaceChild(document.importNode(edited, true), current);
+        return;
+    }
+
+    const KBookmarkGroup root = bookmarkManager->root();
+    for (const KBookmark &bookmark : std::as_const(unsavedBookmarks)) {
+        const QString id = bookmark.metaDataItem(QStringLiteral("ID"));
+        const QString udi = bookmark.metaDataItem(QStringLiteral("UDI"));
+        for (KBookmark other = root.first(); !other.isNull(); other = root.next(other)) {
+            if ((!id.isEmpty() && other.metaDataItem(QStringLiteral("ID")) == id) //
+                || (!udi.isEmpty() && other.metaDataItem(QStringLiteral("UDI")) == udi)) {
+                QDomElement element = other.internalElement();
+                element.parentNode().replaceChild(document.importNode(bookmark.internalElement(), true), element);
+                break;
+            }
+        }
+    }
+}
+
+QByteArray SFilePlacesModelPrivate::readBookmarksStamp() const
+{
+    return fileStamp(bookmarksFile);
+}
+
+void SFilePlacesModelPrivate::announceChange(const QByteArray &previousStamp, const KBookmark &bookmark)
+{
+    // This replaces the bookmarksChanged() broadcast of emitChanged(), which
+    // makes every KBookmarkManager on the file parse all of it right away.
+    // Other places models parse it again when they get this, and patch the
+    // one row if they can. Anything else using KBookmarkManager on the file
+    // finds out through the file watch KBookmarkManager keeps on it.
+    //
+    // Without one bookmark to point at, the address is empty and the others
+    // reload everything.
+    QDBusMessage message =
+        QDBusMessage::createSignal(QStringLiteral("/SFilePlacesModel"), QStringLiteral("org.kde.SFilePlacesModel"), QStringLiteral("placeChanged"));
+    message << bookmarksFile << previousStamp << bookmarksStamp << (bookmark.isNull() ? QString() : bookmark.address());
+    QDBusConnection::sessionBus().send(message);
+}
+
+void SFilePlacesModelPrivate::_k_placeChanged(const QString &file, const QByteArray &previousStamp, const QByteArray &stamp, const QString &address)
 {
-    bookmarkManager->emitChanged(bookmarkManager->root()); // ... we'll get relisted anyway
+    // Our own announcements come back to us too, we're at that stamp already
+    if (file != bookmarksFile || stamp == bookmarksStamp) {
+        return;
+    }
+    if (previousStamp == bookmarksStamp) {
+        pendingDelta = {previousStamp, stamp, address};
+    }
+
+    // Nobody else tells KBookmarkManager to read the file again, unless its
+    // file watch is quicker. If the file isn't there yet it's up to that.
+    if (readBookmarksStamp() == stamp) {
+        bookmarkManager->notifyCompleteChange(QString());
+    }
+}
+
+void SFilePlacesModelPrivate::bookmarksFileChanged()
+{
+    if (savingBookmarks) {
+        return;
+    }
+
+    // KBookmarkManager tells us about every change twice, and about its own
+    // saves as well, those are no news
+    const QByteArray stamp = readBookmarksStamp();
+    const bool sameDocument = bookmarkManager->internalDocument() == bookmarksDocument;
+    if (stamp == bookmarksStamp && sameDocument && !stamp.isEmpty()) {
+        return;
+    }
+
+    // Another process saved while our edits were waiting for the timer, and
+    // KBookmarkManager dropped them along with the document it read before.
+    // Ours are the newer ones, so they're put back and go out with the flush.
+    if (savePending && !sameDocument) {
+        pendingDelta = PlaceDelta();
+        bookmarksStamp = stamp;
+        restoreUnsavedBookmarks();
+        reloadBookmarks();
+        return;
+    }
+
+    // Read again without changes, or with one we were told about
+    bool canPatch = !stamp.isEmpty() && stamp == bookmarksStamp;
+    QString address;
+    if (!canPatch && !stamp.isEmpty() && !pendingDelta.address.isEmpty() && pendingDelta.previousStamp == bookmarksStamp && pendingDelta.stamp == stamp) {
+        canPatch = true;
+        address = pendingDelta.address;
+    }
+    pendingDelta = PlaceDelta();
+    bookmarksStamp = stamp;
+
+    if (!canPatch || !patchBookmarks(address)) {
+        reloadBookmarks();
+    }
+}
+
+bool SFilePlacesModelPrivate::patchBookmarks(const QString &address)
+{
+    if (!bookmarksIndex || !bookmarksIndex->rebind(bookmarkManager->root())) {
+        return false;
+    }
+    bookmarksDocument = bookmarkManager->internalDocument();
+
+    if (address.isEmpty()) {
+        return true;
+    }
+
+    const KBookmark bookmark = bookmarkManager->findByAddress(address);
+    const int row = bookmarksIndex->bookmarks.indexOf(bookmark);
+    if (bookmark.isNull() || row < 0) {
+        return false;
+    }
+
+    // Anything that decides whether and where the place is shown needs the
+    // whole reload
+    SFilePlacesIndex edited;
+    edited.append(bookmark);
+    if (edited.placeIds.at(0) != bookmarksIndex->placeIds.at(row) //
+        || edited.udis.at(0) != bookmarksIndex->udis.at(row) //
+        || edited.tags.at(0) != bookmarksIndex->tags.at(row) //
+        || edited.appNames.at(0) != bookmarksIndex->appNames.at(row) //
+        || edited.groupTypes.at(0) != bookmarksIndex->groupTypes.at(row) //
+        || edited.urls.at(0).scheme() != bookmarksIndex->urls.at(row).scheme()) {
+        return false;
+    }
+
+    int itemRow = -1;
+    for (int i = 0; i < items.count(); ++i) {
+        if (items.at(i)->indexRow() == row) {
+            itemRow = i;
+            break;
+        }
+    }
+
+    if (itemRow < 0) {
+        bookmarksIndex->setRow(row, bookmark);
+        return true;
+    }
+
+    SFilePlacesItem *item = items.at(itemRow);
+    trackItem(item, -1);
+    bookmarksIndex->setRow(row, bookmark);
+    item->setIndexRow(bookmarksIndex, row);
+    trackItem(item, 1);
+    urlTrie.insert(item, item->data(SFilePlacesModel::UrlRole).toUrl());
+
+    const QModelIndex index = q->index(itemRow, 0);
+    Q_EMIT q->dataChanged(index, index);
+    return true;
 }
 
 Qt::DropActions SFilePlacesModel::supportedDropActions() const
@@ -1071,6 +1570,11 @@ void SFilePlacesModel::refresh() const
     d->reloadAndSignal();
 }
 
+void SFilePlacesModel::flush()
+{
+    d->flush();
+}
+
 QUrl SFilePlacesModel::convertedUrl(const QUrl &url)
 {
     QUrl newUrl = url;
@@ -1145,7 +1649,7 @@ void SFilePlacesModel::editPlace(const QModelIndex &index, const QString &text,
     }
 
     if (changed) {
-        refresh();
+        d->reloadAndSignal(bookmark);
         Q_EMIT dataChanged(index, index);
     }
 }
@@ -1189,9 +1693,11 @@ void SFilePlacesModel::setPlaceHidden(const QModelIndex &index, bool hidden)
     const bool showingChildOnShownParent = !hidden && !groupHidden;
 
     if (hidingChildOnShownParent || showingChildOnShownParent) {
+        d->trackItem(item, -1);
         item->setHidden(hidden);
+        d->trackItem(item, 1);
 
-        d->reloadAndSignal();
+        d->reloadAndSignal(item->bookmark());
         Q_EMIT dataChanged(index, index);
     }
 }
@@ -1203,6 +1709,8 @@ void SFilePlacesModel::setGroupHidden(const GroupType type, bool hidden)
     }
 
     d->bookmarkManager->root().setMetaDataItem(stateNameForGroupType(type), (hidden ? QStringLiteral("true") : QStringLiteral("false")));
+    d->setGroupHiddenBit(type, hidden);
+    d->visibleRowsValid = false;
     d->reloadAndSignal();
     Q_EMIT groupHiddenChanged(type, hidden);
 }
@@ -1257,6 +1765,8 @@ bool SFilePlacesModel::movePlace(int itemRow, int row)
     // item has been removed from its original position. That is why we
     // adjust if necessary.
     d->items.move(itemRow, itemRow < destRow ? (destRow - 1) : destRow);
+    d->itemRowsValid = false;
+    d->visibleRowsValid = false;
     endMoveRows();
 
     return true;
@@ -1264,16 +1774,27 @@ bool SFilePlacesModel::movePlace(int itemRow, int row)
 
 int SFilePlacesModel::hiddenCount() const
 {
-    int rows = rowCount();
     int hidden = 0;
+    for (int type = 0; type <= TagsType; ++type) {
+        hidden += isGroupHidden(static_cast<GroupType>(type)) ? d->groupItemCounts[type] : d->groupHiddenPlaceCounts[type];
+    }
+    return hidden;
+}
 
-    for (int i = 0; i < rows; ++i) {
-        if (isHidden(index(i, 0))) {
-            hidden++;
+QVector<int> SFilePlacesModel::visibleRows() const
+{
+    if (!d->visibleRowsValid) {
+        d->visibleRows.clear();
+        d->visibleRows.reserve(d->items.count() - hiddenCount());
+        for (int row = 0; row < d->items.count(); ++row) {
+            const SFilePlacesItem *item = d->items.at(row);
+            if (!item->isHidden() && !isGroupHidden(item->groupType())) {
+                d->visibleRows.append(row);
+            }
         }
+        d->visibleRowsValid = true;
     }
-
-    return hidden;
+    return d->visibleRows;
 }
 
 void SFilePlacesModel::setSupportedSchemes(const QStringList &schemes)
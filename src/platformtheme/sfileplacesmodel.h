@@ -10,11 +10,12 @@
 #define sfileplacESMODEL_H
 
 #include "kiofilewidgets_export.h"
+#include "smountwatcher.h"
 
 #include <KBookmark>
 #include <QAbstractItemModel>
 #include <QUrl>
-#include <QStorageInfo>
+#include <QVector>
 
 #include <memory>
 
@@ -45,6 +46,7 @@ public:
         GroupRole = 0x0a5b64ee, ///< @since 5.40 /// The name of the group, for example "Remote" or "Devices".
         IconNameRole = 0x00a45c00, ///< @since 5.41 @see icon()
         GroupHiddenRole = 0x21a4b936, ///< @since 5.42 @see isGroupHidden()
+        CapacityRole = 0x03C20700, /// How full the device is, in percent. Invalid until known. @see CapacityBarRecommendedRole
     };
 
     /// @since 5.42
@@ -114,10 +116,11 @@ public:
     bool isDevice(const QModelIndex &index) const;
 
     /**
-     * @return The solid device of the place at index @p index, if it is a device. Otherwise a default Solid::Device() instance is returned.
+     * @return The mount of the place at index @p index, if it is a device. Otherwise an empty mount is returned.
+     * This is what SMountWatcher last read, the filesystem itself isn't touched.
      * @see isDevice()
      */
-    QStorageInfo deviceForIndex(const QModelIndex &index) const;
+    SMountWatcher::Mount deviceForIndex(const QModelIndex &index) const;
 
     /**
      * @return The KBookmark instance of the place at index @p index.
@@ -206,6 +209,12 @@ public:
      */
     int hiddenCount() const;
 
+    /**
+     * @return The rows of the places that are not hidden, in order.
+     * @see isHidden()
+     */
+    QVector<int> visibleRows() const;
+
     /**
      * @brief Get a visible data based on Qt role for the given index.
      * Return the device information for the give index.
@@ -265,6 +274,15 @@ public:
      */
     void refresh() const;
 
+    /**
+     * @brief Writes pending changes to the places to disk right away
+     *
+     * Changes are written once the model has been left alone for a moment,
+     * all of them in one go. This is done when the model is deleted too, but
+     * a dialog that's only hidden should call it when it closes.
+     */
+    void flush();
+
     /**
      * @brief  Converts the URL, which contains "virtual" URLs for system-items like
      *         "timeline:/lastmonth" into a Query-URL "timeline:/2017-10"
@@ -320,6 +338,8 @@ Q_SIGNALS:
     void reloaded();
 
 private:
+    Q_PRIVATE_SLOT(d, void _k_placeChanged(const QString &, const QByteArray &, const QByteArray &, const QString &))
+
     friend class SFilePlacesModelPrivate;
     std::unique_ptr<SFilePlacesModelPrivate> d;
 };
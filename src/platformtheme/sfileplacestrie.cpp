@@ -0,0 +1,112 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-only
+*/
+
+#include "sfileplacestrie_p.h"
+
+SFilePlacesTrie::~SFilePlacesTrie()
+{
+    clear();
+}
+
+void SFilePlacesTrie::insert(SFilePlacesItem *item, const QUrl &url)
+{
+    remove(item);
+
+    const QString key = rootKey(url);
+    Node *node = m_roots.value(key);
+    if (!node) {
+        node = new Node;
+        node->component = key;
+        m_roots.insert(key, node);
+    }
+
+    const QStringList components = pathComponents(url);
+    for (const QString &component : components) {
+        Node *child = node->children.value(component);
+        if (!child) {
+            child = new Node;
+            child->parent = node;
+            child->component = component;
+            node->children.insert(component, child);
+        }
+        node = child;
+    }
+
+    node->items.append(item);
+    m_nodes.insert(item, node);
+}
+
+void SFilePlacesTrie::remove(SFilePlacesItem *item)
+{
+    Node *node = m_nodes.take(item);
+    if (!node) {
+        return;
+    }
+
+    node->items.removeOne(item);
+
+    // Prune what's not leading anywhere anymore
+    while (node->items.isEmpty() && node->children.isEmpty()) {
+        Node *parent = node->parent;
+        if (parent) {
+            parent->children.remove(node->component);
+        } else {
+            m_roots.remove(node->component);
+        }
+        delete node;
+
+        if (!parent) {
+            break;
+        }
+        node = parent;
+    }
+}
+
+void SFilePlacesTrie::clear()
+{
+    qDeleteAll(m_roots);
+    m_roots.clear();
+    m_nodes.clear();
+}
+
+void SFilePlacesTrie::findParents(const QUrl &url, const std::function<bool(const QVector<SFilePlacesItem *> &, bool)> &visit) const
+{
+    const Node *node = m_roots.value(rootKey(url));
+    if (!node) {
+        return;
+    }
+
+    QVector<const Node *> path;
+    path.append(node);
+
+    const QStringList components = pathComponents(url);
+    for (const QString &component : components) {
+        node = node->children.value(component);
+        if (!node) {
+            break;
+        }
+        path.append(node);
+    }
+    const bool reachedEnd = path.count() == components.count() + 1;
+
+    for (int i = path.count() - 1; i >= 0; --i) {
+        const Node *current = path.at(i);
+        if (!current->items.isEmpty() && visit(current->items, reachedEnd && i == path.count() - 1)) {
+            return;
+        }
+    }
+}
+
+QString SFilePlacesTrie::rootKey(const QUrl &url)
+{
+    // Like QUrl::isParentOf(), which only looks at these and the path
+    return url.scheme() + QLatin1Char('|') + url.authority();
+}
+
+QStringList SFilePlacesTrie::pathComponents(const QUrl &url)
+{
+    return url.path().split(QLatin1Char('/'), Qt::SkipEmptyParts);
+}
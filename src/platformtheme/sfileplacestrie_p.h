@@ -0,0 +1,71 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-only
+*/
+
+#ifndef SFILEPLACESTRIE_P_H
+#define SFILEPLACESTRIE_P_H
+
+#include <QHash>
+#include <QStringList>
+#include <QUrl>
+#include <QVector>
+
+#include <functional>
+
+class SFilePlacesItem;
+
+/**
+ * The urls of the places, by scheme and authority and then by path
+ * component, so the places containing a url are found by walking down its
+ * path once instead of comparing it with every place.
+ *
+ * Hidden places stay in here, the model skips them when looking things up;
+ * hiding and showing doesn't touch the trie.
+ */
+class SFilePlacesTrie
+{
+public:
+    SFilePlacesTrie() = default;
+    ~SFilePlacesTrie();
+
+    SFilePlacesTrie(const SFilePlacesTrie &) = delete;
+    SFilePlacesTrie &operator=(const SFilePlacesTrie &) = delete;
+
+    /**
+     * Adds @p item under @p url, or moves it there if it's in already.
+     */
+    void insert(SFilePlacesItem *item, const QUrl &url);
+    void remove(SFilePlacesItem *item);
+    void clear();
+
+    /**
+     * Calls @p visit with the items at @p url and at each of its parents,
+     * deepest first, until it returns true. @p exact is true for the items
+     * with the same path as @p url; those can still differ in the query.
+     */
+    void findParents(const QUrl &url, const std::function<bool(const QVector<SFilePlacesItem *> &items, bool exact)> &visit) const;
+
+private:
+    struct Node {
+        ~Node()
+        {
+            qDeleteAll(children);
+        }
+
+        Node *parent = nullptr;
+        // For the roots, their key in m_roots
+        QString component;
+        QHash<QString, Node *> children;
+        QVector<SFilePlacesItem *> items;
+    };
+
+    static QString rootKey(const QUrl &url);
+    static QStringList pathComponents(const QUrl &url);
+
+    QHash<QString, Node *> m_roots;
+    QHash<SFilePlacesItem *, Node *> m_nodes;
+};
+
+#endif
@@ -16,6 +16,7 @@
 #include <QKeyEvent>
 #include <QMenu>
 #include <QPainter>
+#include <QPixmapCache>
 #include <QPointer>
 #include <QScrollBar>
 #include <QTimeLine>
@@ -24,6 +25,7 @@
 #include <KCapacityBar>
 #include <KConfig>
 #include <KConfigGroup>
+#include <KIconLoader>
 #include <KJob>
 #include <KJobWidgets>
 #include <KLocalizedString>
@@ -31,7 +33,6 @@
 #include <KSharedConfig>
 #include <defaults-kfile.h> // ConfigGroup, PlacesIconsAutoresize, PlacesIconsStaticSize
 #include <kdirnotify.h>
-#include <kio/filesystemfreespacejob.h>
 #include <kio/jobuidelegate.h>
 #include <kmountpoint.h>
 #include <kpropertiesdialog.h>
@@ -42,13 +43,6 @@
 static constexpr int s_lateralMargin = 4;
 static constexpr int s_capacitybarHeight = 6;
 
-struct PlaceFreeSpaceInfo {
-    QDateTime lastUpdated;
-    KIO::filesize_t used = 0;
-    KIO::filesize_t size = 0;
-    QPointer<KIO::FileSystemFreeSpaceJob> job;
-};
-
 class SFilePlacesViewDelegate : public QAbstractItemDelegate
 {
     Q_OBJECT
@@ -82,9 +76,22 @@ public:
 
     int sectionHeaderHeight() const;
 
-    void clearFreeSpaceInfo();
+    /**
+     * Drops the cached rows of all views, after a change the keys don't
+     * cover, like the icon theme.
+     */
+    static void clearRowCache();
 
 private:
+    enum RowLayer {
+        BaseLayer, // background and icon
+        TextLayer,
+        CapacityLayer, // text and capacity bar
+    };
+
+    QPixmap rowLayer(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index, RowLayer layer) const;
+    void drawRowLayer(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index, RowLayer layer) const;
+
     QString groupNameFromIndex(const QModelIndex &index) const;
     QModelIndex previousVisibleIndex(const QModelIndex &index) const;
     bool indexIsSectionHeader(const QModelIndex &index) const;
@@ -110,8 +117,6 @@ private:
 
     QMap<QPersistentModelIndex, QTimeLine *> m_timeLineMap;
     QMap<QTimeLine *, QPersistentModelIndex> m_timeLineInverseMap;
-
-    mutable QMap<QPersistentModelIndex, PlaceFreeSpaceInfo> m_freeSpaceInfo;
 };
 
 SFilePlacesViewDelegate::SFilePlacesViewDelegate(SFilePlacesView *parent)
@@ -187,29 +192,128 @@ void SFilePlacesViewDelegate::paint(QPainter *painter, const QStyleOptionViewIte
         opt.state &= ~QStyle::State_MouseOver;
     }
 
-    QApplication::style()->drawPrimitive(QStyle::PE_PanelItemViewItem, &opt, painter);
+    // Rows that grow or shrink change size on every step, those are drawn
+    // straight away instead of through a pixmap that's only used once
+    const bool animating = m_appearingItems.contains(index) || m_disappearingItems.contains(index);
+    const auto drawLayer = [this, painter, &opt, &index, animating](RowLayer layer) {
+        if (animating) {
+            painter->save();
+            drawRowLayer(painter, opt, index, layer);
+            painter->restore();
+        } else {
+            painter->drawPixmap(opt.rect.topLeft(), rowLayer(painter, opt, index, layer));
+        }
+    };
+    drawLayer(BaseLayer);
 
-    bool isLTR = opt.direction == Qt::LeftToRight;
+    // While fading between the two, the capacity bar and the plain text are
+    // drawn on top of each other
+    qreal capacityOpacity = 0;
+    if (placesModel->data(index, SFilePlacesModel::CapacityBarRecommendedRole).toBool()) {
+        // Filled in by the model when known, it tells us when it changes
+        if (placesModel->data(index, SFilePlacesModel::CapacityRole).isValid()) {
+            capacityOpacity = contentsOpacity(index);
+        }
+    }
 
-    const QPalette activePalette = KIconLoader::global()->customPalette();
-    const bool changePalette = activePalette != opt.palette;
-    if (changePalette) {
-        KIconLoader::global()->setCustomPalette(opt.palette);
+    const qreal opacity = painter->opacity();
+    if (capacityOpacity > 0) {
+        painter->setOpacity(opacity * capacityOpacity);
+        drawLayer(CapacityLayer);
+    }
+    if (capacityOpacity < 1) {
+        painter->setOpacity(opacity * (1 - capacityOpacity));
+        drawLayer(TextLayer);
     }
 
-    QIcon icon = index.model()->data(index, Qt::DecorationRole).value<QIcon>();
-    QPixmap pm =
-        icon.pixmap(m_iconSize, m_iconSize, (opt.state & QStyle::State_Selected) && (opt.state & QStyle::State_Active) ? QIcon::Selected : QIcon::Normal);
-    QPoint point(isLTR ? opt.rect.left() + s_lateralMargin : opt.rect.right() - s_lateralMargin - m_iconSize,
-                 opt.rect.top() + (opt.rect.height() - m_iconSize) / 2);
-    painter->drawPixmap(point, pm);
+    painter->restore();
+}
 
-    if (changePalette) {
-        if (activePalette == QPalette()) {
-            KIconLoader::global()->resetPalette();
-        } else {
-            KIconLoader::global()->setCustomPalette(activePalette);
+// Part of every row cache key, so bumping it drops them all
+static int s_rowCacheGeneration = 0;
+
+void SFilePlacesViewDelegate::clearRowCache()
+{
+    s_rowCacheGeneration++;
+}
+
+QPixmap SFilePlacesViewDelegate::rowLayer(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index, RowLayer layer) const
+{
+    const qreal dpr = painter->device()->devicePixelRatioF();
+
+    // Everything the layer's looks depend on. Rows that look the same share
+    // their pixmaps, and a row whose text, icon or state changed misses.
+    QString key = QStringLiteral("splacesrow_%1_%2x%3@%4_%5_%6_%7_%8_%9")
+                      .arg(int(layer))
+                      .arg(option.rect.width())
+                      .arg(option.rect.height())
+                      .arg(dpr)
+                      .arg(int(option.state))
+                      .arg(int(option.features))
+                      .arg(int(option.viewItemPosition))
+                      .arg(int(option.direction))
+                      .arg(option.palette.cacheKey());
+    key += QLatin1Char('_') + QString::number(m_iconSize) + QLatin1Char('_') + QString::number(s_rowCacheGeneration);
+    if (layer == BaseLayer) {
+        key += QLatin1Char('_') + QString::number(index.data(Qt::DecorationRole).value<QIcon>().cacheKey());
+    } else {
+        key += QLatin1Char('_') + QString::number(painter->pen().color().rgba()) + QLatin1Char('_') + painter->font().key();
+        if (layer == CapacityLayer) {
+            key += QLatin1Char('_') + QString::number(index.data(SFilePlacesModel::CapacityRole).toInt());
+        }
+        key += QLatin1Char('_') + index.data().toString();
+    }
+
+    QPixmap pixmap;
+    if (QPixmapCache::find(key, &pixmap)) {
+        return pixmap;
+    }
+
+    pixmap = QPixmap(option.rect.size() * dpr);
+    pixmap.setDevicePixelRatio(dpr);
+    pixmap.fill(Qt::transparent);
+
+    QStyleOptionViewItem opt = option;
+    opt.rect.moveTo(0, 0);
+
+    QPainter p(&pixmap);
+    p.setFont(painter->font());
+    p.setPen(painter->pen());
+    drawRowLayer(&p, opt, index, layer);
+    p.end();
+
+    QPixmapCache::insert(key, pixmap);
+    return pixmap;
+}
+
+void SFilePlacesViewDelegate::drawRowLayer(QPainter *painter, const QStyleOptionViewItem &opt, const QModelIndex &index, RowLayer layer) const
+{
+    bool isLTR = opt.direction == Qt::LeftToRight;
+
+    if (layer == BaseLayer) {
+        QApplication::style()->drawPrimitive(QStyle::PE_PanelItemViewItem, &opt, painter);
+
+        const QPalette activePalette = KIconLoader::global()->customPalette();
+        const bool changePalette = activePalette != opt.palette;
+        if (changePalette) {
+            KIconLoader::global()->setCustomPalette(opt.palette);
         }
+
+        QIcon icon = index.model()->data(index, Qt::DecorationRole).value<QIcon>();
+        QPixmap pm =
+            icon.pixmap(m_iconSize, m_iconSize, (opt.state & QStyle::State_Selected) && (opt.state & QStyle::State_Active) ? QIcon::Selected : QIcon::Normal);
+        QPoint point(isLTR ? opt.rect.left() + s_lateralMargin : opt.rect.right() - s_lateralMargin - m_iconSize,
+                     opt.rect.top() + (opt.rect.height() - m_iconSize) / 2);
+        painter->drawPixmap(point, pm);
+
+        if (changePalette) {
+            if (activePalette == QPalette()) {
+                KIconLoader::global()->resetPalette();
+            } else {
+                KIconLoader::global()->setCustomPalette(activePalette);
+            }
+        }
+        return;
     }
 
     if (opt.state & QStyle::State_Selected) {
@@ -224,59 +328,20 @@ void SFilePlacesViewDelegate::paint(QPainter *painter, const QStyleOptionViewIte
 
     QRect rectText;
 
-    bool drawCapacityBar = false;
-    if (placesModel->data(index, SFilePlacesModel::CapacityBarRecommendedRole).toBool()) {
-        const QUrl url = placesModel->url(index);
-        if (contentsOpacity(index) > 0) {
-            QPersistentModelIndex persistentIndex(index);
-            PlaceFreeSpaceInfo &info = m_freeSpaceInfo[persistentIndex];
-
-            drawCapacityBar = info.size > 0;
-            if (drawCapacityBar) {
-                painter->save();
-                painter->setOpacity(painter->opacity() * contentsOpacity(index));
-
-                int height = opt.fontMetrics.height() + s_capacitybarHeight;
-                rectText = QRect(isLTR ? m_iconSize + s_lateralMargin * 2 + opt.rect.left() : 0,
-                                 opt.rect.top() + (opt.rect.height() / 2 - height / 2),
-                                 opt.rect.width() - m_iconSize - s_lateralMargin * 2,
-                                 opt.fontMetrics.height());
-                painter->drawText(rectText,
-                                  Qt::AlignLeft | Qt::AlignTop,
-                                  opt.fontMetrics.elidedText(index.model()->data(index).toString(), Qt::ElideRight, rectText.width()));
-                QRect capacityRect(isLTR ? rectText.x() : s_lateralMargin, rectText.bottom() - 1, rectText.width() - s_lateralMargin, s_capacitybarHeight);
-                KCapacityBar capacityBar(KCapacityBar::DrawTextInline);
-                capacityBar.setValue((info.used * 100) / info.size);
-                capacityBar.drawCapacityBar(painter, capacityRect);
-
-                painter->restore();
-
-                painter->save();
-                painter->setOpacity(painter->opacity() * (1 - contentsOpacity(index)));
-            }
-
-            if (!info.job && (!info.lastUpdated.isValid() || info.lastUpdated.secsTo(QDateTime::currentDateTimeUtc()) > 60)) {
-                info.job = KIO::fileSystemFreeSpace(url);
-                connect(info.job,
-                        &KIO::FileSystemFreeSpaceJob::result,
-                        this,
-                        [this, persistentIndex](KIO::Job *job, KIO::filesize_t size, KIO::filesize_t available) {
-                            PlaceFreeSpaceInfo &info = m_freeSpaceInfo[persistentIndex];
-
-                            // even if we receive an error we want to refresh lastUpdated to avoid repeatedly querying in this case
-                            info.lastUpdated = QDateTime::currentDateTimeUtc();
-
-                            if (job->error()) {
-                                return;
-                            }
-
-                            info.size = size;
-                            info.used = size - available;
-
-                            // FIXME scheduleDelayedItemsLayout but we're in the delegate here, not the view
-                        });
-            }
-        }
+    if (layer == CapacityLayer) {
+        int height = opt.fontMetrics.height() + s_capacitybarHeight;
+        rectText = QRect(isLTR ? m_iconSize + s_lateralMargin * 2 + opt.rect.left() : 0,
+                         opt.rect.top() + (opt.rect.height() / 2 - height / 2),
+                         opt.rect.width() - m_iconSize - s_lateralMargin * 2,
+                         opt.fontMetrics.height());
+        painter->drawText(rectText,
+                          Qt::AlignLeft | Qt::AlignTop,
+                          opt.fontMetrics.elidedText(index.model()->data(index).toString(), Qt::ElideRight, rectText.width()));
+        QRect capacityRect(isLTR ? rectText.x() : s_lateralMargin, rectText.bottom() - 1, rectText.width() - s_lateralMargin, s_capacitybarHeight);
+        KCapacityBar capacityBar(KCapacityBar::DrawTextInline);
+        capacityBar.setValue(index.model()->data(index, SFilePlacesModel::CapacityRole).toInt());
+        capacityBar.drawCapacityBar(painter, capacityRect);
+        return;
     }
 
     rectText = QRect(isLTR ? m_iconSize + s_lateralMargin * 2 + opt.rect.left() : 0,
@@ -286,12 +351,6 @@ void SFilePlacesViewDelegate::paint(QPainter *painter, const QStyleOptionViewIte
     painter->drawText(rectText,
                       Qt::AlignLeft | Qt::AlignVCenter,
                       opt.fontMetrics.elidedText(index.model()->data(index).toString(), Qt::ElideRight, rectText.width()));
-
-    if (drawCapacityBar) {
-        painter->restore();
-    }
-
-    painter->restore();
 }
 
 int SFilePlacesViewDelegate::iconSize() const
@@ -425,11 +484,6 @@ void SFilePlacesViewDelegate::startDrag()
     m_dragStarted = true;
 }
 
-void SFilePlacesViewDelegate::clearFreeSpaceInfo()
-{
-    m_freeSpaceInfo.clear();
-}
-
 QString SFilePlacesViewDelegate::groupNameFromIndex(const QModelIndex &index) const
 {
     if (index.isValid()) {
@@ -630,6 +684,11 @@ SFilePlacesView::SFilePlacesView(QWidget *parent)
     connect(this, &SFilePlacesView::clicked, this, [this](const QModelIndex &index) {
         d->placeClicked(index);
     });
+    // The icons of the places keep their cache keys when the theme changes
+    connect(KIconLoader::global(), &KIconLoader::iconChanged, this, [this]() {
+        SFilePlacesViewDelegate::clearRowCache();
+        viewport()->update();
+    });
     // Note: Don't connect to the activated() signal, as the behavior when it is
     // committed depends on the used widget style. The click behavior of
     // SFilePlacesView should be style independent.
@@ -1025,6 +1084,21 @@ void SFilePlacesView::hideEvent(QHideEvent *event)
     d->m_smoothItemResizing = false;
 }
 
+void SFilePlacesView::changeEvent(QEvent *event)
+{
+    QListView::changeEvent(event);
+    switch (event->type()) {
+    case QEvent::StyleChange:
+    case QEvent::PaletteChange:
+    case QEvent::ThemeChange:
+        SFilePlacesViewDelegate::clearRowCache();
+        viewport()->update();
+        break;
+    default:
+        break;
+    }
+}
+
 void SFilePlacesView::dragEnterEvent(QDragEnterEvent *event)
 {
     QListView::dragEnterEvent(event);
@@ -1164,8 +1238,6 @@ void SFilePlacesView::setModel(QAbstractItemModel *model)
         },
         Qt::QueuedConnection);
     connect(selectionModel(), &QItemSelectionModel::currentChanged, d->m_watcher, &SFilePlacesEventWatcher::currentIndexChanged);
-
-    d->m_delegate->clearFreeSpaceInfo();
 }
 
 void SFilePlacesView::rowsInserted(const QModelIndex &parent, int start, int end)
@@ -1200,11 +1272,10 @@ QSize SFilePlacesView::sizeHint() const
     QFontMetrics fm = d->q->fontMetrics();
     int textWidth = 0;
 
-    for (int i = 0; i < placesModel->rowCount(); ++i) {
-        QModelIndex index = placesModel->index(i, 0);
-        if (!placesModel->isHidden(index)) {
-            textWidth = qMax(textWidth, fm.boundingRect(index.data(Qt::DisplayRole).toString()).width());
-        }
+    const QVector<int> visibleRows = placesModel->visibleRows();
+    for (int row : visibleRows) {
+        const QModelIndex index = placesModel->index(row, 0);
+        textWidth = qMax(textWidth, fm.boundingRect(index.data(Qt::DisplayRole).toString()).width());
     }
 
     const int iconSize = style()->pixelMetric(QStyle::PM_SmallIconSize) + 3 * s_lateralMargin;
@@ -1275,12 +1346,10 @@ void SFilePlacesViewPrivate::adaptItemSize()
 
     int textWidth = 0;
     QFontMetrics fm = q->fontMetrics();
-    for (int i = 0; i < placesModel->rowCount(); ++i) {
-        QModelIndex index = placesModel->index(i, 0);
-
-        if (!placesModel->isHidden(index)) {
-            textWidth = qMax(textWidth, fm.boundingRect(index.data(Qt::DisplayRole).toString()).width());
-        }
+    const QVector<int> visibleRows = placesModel->visibleRows();
+    for (int row : visibleRows) {
+        const QModelIndex index = placesModel->index(row, 0);
+        textWidth = qMax(textWidth, fm.boundingRect(index.data(Qt::DisplayRole).toString()).width());
     }
 
     const int margin = q->style()->pixelMetric(QStyle::PM_FocusFrameHMargin, nullptr, q) + 1;
@@ -1333,13 +1402,15 @@ void SFilePlacesViewPrivate::updateHiddenRows()
     int rowCount = placesModel->rowCount();
     QModelIndex current = placesModel->closestItem(m_currentUrl);
 
+    // Both in order, so walk them side by side
+    const QVector<int> visibleRows = placesModel->visibleRows();
+    auto nextVisible = visibleRows.constBegin();
     for (int i = 0; i < rowCount; ++i) {
-        QModelIndex index = placesModel->index(i, 0);
-        if (index != current && placesModel->isHidden(index) && !m_showAll) {
-            q->setRowHidden(i, true);
-        } else {
-            q->setRowHidden(i, false);
+        const bool visible = nextVisible != visibleRows.constEnd() && *nextVisible == i;
+        if (visible) {
+            ++nextVisible;
         }
+        q->setRowHidden(i, !visible && !m_showAll && i != current.row());
     }
 
     adaptItemSize();
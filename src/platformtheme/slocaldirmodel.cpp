@@ -0,0 +1,793 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "slocaldirmodel.h"
+#include "sdirwatcher.h"
+
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QIcon>
+#include <QRunnable>
+#include <QSet>
+
+#include <KIO/UDSEntry>
+#include <kdirmodel.h>
+#include <kfileitem.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+struct SLocalDirModel::Node {
+    ~Node()
+    {
+        qDeleteAll(children);
+    }
+
+    QString name;
+    Node *parent = nullptr;
+    int row = 0;
+    QVector<Node *> children;
+    bool listed = false;
+    bool listing = false;
+    // Resolved by the worker threads, empty until then
+    QString iconName;
+    QIcon icon;
+    // The st_mode the worker threads found, 0 until then
+    uint mode = 0;
+};
+
+namespace
+{
+
+// With the permissions known, KFileItem has no reason to stat() by itself
+KFileItem directoryItem(const QString &path, const QString &name, uint mode)
+{
+    KIO::UDSEntry entry;
+    entry.reserve(4);
+    entry.fastInsert(KIO::UDSEntry::UDS_NAME, name);
+    entry.fastInsert(KIO::UDSEntry::UDS_FILE_TYPE, S_IFDIR);
+    entry.fastInsert(KIO::UDSEntry::UDS_ACCESS, mode & 07777);
+    entry.fastInsert(KIO::UDSEntry::UDS_MIME_TYPE, QStringLiteral("inode/directory"));
+    return KFileItem(entry, QUrl::fromLocalFile(path));
+}
+
+// Might read a .directory file, so it's only called on the worker threads
+QString directoryIconName(const QString &path, const QString &name, uint mode)
+{
+    return directoryItem(path, name, mode).iconName();
+}
+
+QString childPath(const QString &path, const QString &name)
+{
+    return path.endsWith(QLatin1Char('/')) ? path + name : path + QLatin1Char('/') + name;
+}
+
+// Only directories (and symlinks to them) end up in @p names. Everything
+// else is skipped based on the dirent type, without a stat. Directories are
+// stat()ed here for their permissions, so their file items don't do that on
+// the GUI thread.
+bool listDirectories(const QString &path, const std::atomic<bool> &cancelled, QStringList *names, QStringList *iconNames, QVector<uint> *modes)
+{
+    DIR *dir = opendir(QFile::encodeName(path).constData());
+    if (!dir) {
+        return false;
+    }
+
+    const int fd = dirfd(dir);
+    while (struct dirent *entry = readdir(dir)) {
+        if (cancelled) {
+            break;
+        }
+
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+
+        switch (entry->d_type) {
+        case DT_DIR:
+        case DT_LNK:
+        case DT_UNKNOWN: // some filesystems don't fill in d_type
+            break;
+        default:
+            continue;
+        }
+        struct stat buff;
+        if (fstatat(fd, name, &buff, 0) != 0 || !S_ISDIR(buff.st_mode)) {
+            continue;
+        }
+
+        const QString decodedName = QFile::decodeName(name);
+        names->append(decodedName);
+        iconNames->append(directoryIconName(childPath(path, decodedName), decodedName, buff.st_mode));
+        modes->append(buff.st_mode);
+    }
+
+    closedir(dir);
+    return true;
+}
+
+}
+
+class SLocalDirModel::ListJob : public QRunnable
+{
+public:
+    ListJob(SLocalDirModel *model, const QString &path, const std::shared_ptr<std::atomic<bool>> &cancelled, bool prefetch)
+        : m_model(model)
+        , m_generation(model->m_generation)
+        , m_path(path)
+        , m_cancelled(cancelled)
+        , m_prefetch(prefetch)
+    {
+    }
+
+    void run() override
+    {
+        QStringList names;
+        QStringList iconNames;
+        QVector<uint> modes;
+        const bool ok = listDirectories(m_path, *m_cancelled, &names, &iconNames, &modes);
+        if (*m_cancelled) {
+            return;
+        }
+
+        // The model waits for us before going away, and drops results from
+        // before the last openUrl() by itself
+        SLocalDirModel *model = m_model;
+        const quint64 generation = m_generation;
+        const QString path = m_path;
+        const bool prefetch = m_prefetch;
+        QMetaObject::invokeMethod(model, [model, generation, path, names, iconNames, modes, ok, prefetch]() {
+            model->listingFinished(generation, path, names, iconNames, modes, ok, prefetch);
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    SLocalDirModel *const m_model;
+    const quint64 m_generation;
+    const QString m_path;
+    const std::shared_ptr<std::atomic<bool>> m_cancelled;
+    const bool m_prefetch;
+};
+
+// For directories that showed up through the watcher, without a listing
+class SLocalDirModel::IconJob : public QRunnable
+{
+public:
+    IconJob(SLocalDirModel *model, const QString &path, const QStringList &names, const std::shared_ptr<std::atomic<bool>> &cancelled)
+        : m_model(model)
+        , m_generation(model->m_generation)
+        , m_path(path)
+        , m_names(names)
+        , m_cancelled(cancelled)
+    {
+    }
+
+    void run() override
+    {
+        QStringList iconNames;
+        QVector<uint> modes;
+        iconNames.reserve(m_names.count());
+        modes.reserve(m_names.count());
+        for (const QString &name : m_names) {
+            if (*m_cancelled) {
+                return;
+            }
+            const QString path = childPath(m_path, name);
+            struct stat buff;
+            const uint mode = stat(QFile::encodeName(path).constData(), &buff) == 0 ? buff.st_mode : 0;
+            iconNames.append(directoryIconName(path, name, mode));
+            modes.append(mode);
+        }
+
+        SLocalDirModel *model = m_model;
+        const quint64 generation = m_generation;
+        const QString path = m_path;
+        const QStringList names = m_names;
+        QMetaObject::invokeMethod(model, [model, generation, path, names, iconNames, modes]() {
+            model->iconsResolved(generation, path, names, iconNames, modes);
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    SLocalDirModel *const m_model;
+    const quint64 m_generation;
+    const QString m_path;
+    const QStringList m_names;
+    const std::shared_ptr<std::atomic<bool>> m_cancelled;
+};
+
+SLocalDirModel::SLocalDirModel(QObject *parent)
+    : QAbstractItemModel(parent)
+    , m_cancelled(std::make_shared<std::atomic<bool>>(false))
+    , m_prefetchCancelled(std::make_shared<std::atomic<bool>>(false))
+    , m_watcher(new SDirWatcher(this))
+{
+    // A handful of slow directories shouldn't keep everything else waiting,
+    // but we don't want to hammer the disk either
+    m_threadPool.setMaxThreadCount(4);
+
+    // Prefetching is only a nicety, it shouldn't compete with what the user
+    // actually asked for
+    m_prefetchPool.setMaxThreadCount(2);
+
+    connect(m_watcher, &SDirWatcher::entriesChanged, this, &SLocalDirModel::entriesChanged);
+    connect(m_watcher, &SDirWatcher::directoryChanged, this, &SLocalDirModel::directoryChanged);
+    connect(m_watcher, &SDirWatcher::evicted, this, &SLocalDirModel::watchEvicted);
+}
+
+SLocalDirModel::~SLocalDirModel()
+{
+    *m_cancelled = true;
+    *m_prefetchCancelled = true;
+    m_threadPool.clear();
+    m_prefetchPool.clear();
+    m_threadPool.waitForDone();
+    m_prefetchPool.waitForDone();
+}
+
+void SLocalDirModel::openUrl(const QUrl &url)
+{
+    beginResetModel();
+
+    *m_cancelled = true;
+    m_cancelled = std::make_shared<std::atomic<bool>>(false);
+    cancelPrefetch();
+    m_generation++;
+
+    m_rootPath = QDir::cleanPath(url.toLocalFile());
+    if (m_rootPath.isEmpty()) {
+        m_rootPath = QStringLiteral("/");
+    }
+    m_root.reset(new Node);
+    m_pendingExpand.clear();
+
+    m_watcher->removeAllPaths();
+    // We're always showing what's directly below the root
+    m_watcher->setPinned(m_rootPath, true);
+
+    endResetModel();
+
+    listNode(m_root.get());
+}
+
+QUrl SLocalDirModel::rootUrl() const
+{
+    return QUrl::fromLocalFile(m_rootPath);
+}
+
+QModelIndex SLocalDirModel::indexForUrl(const QUrl &url) const
+{
+    if (!url.isLocalFile()) {
+        return QModelIndex();
+    }
+
+    Node *node = nodeForPath(QDir::cleanPath(url.toLocalFile()));
+    if (!node || node == m_root.get()) {
+        return QModelIndex();
+    }
+    return indexForNode(node);
+}
+
+QUrl SLocalDirModel::urlForIndex(const QModelIndex &index) const
+{
+    const Node *node = nodeForIndex(index);
+    if (!node) {
+        return QUrl();
+    }
+    return QUrl::fromLocalFile(pathForNode(node));
+}
+
+KFileItem SLocalDirModel::itemForIndex(const QModelIndex &index) const
+{
+    const Node *node = nodeForIndex(index);
+    if (!node) {
+        return KFileItem();
+    }
+
+    const QString path = pathForNode(node);
+    if (!node->mode) {
+        return KFileItem(QUrl::fromLocalFile(path), QStringLiteral("inode/directory"), S_IFDIR);
+    }
+    return directoryItem(path, node->name, node->mode);
+}
+
+void SLocalDirModel::prefetch(const QModelIndexList &indexes)
+{
+    // Whatever was asked for before has probably been scrolled away
+    cancelPrefetch();
+
+    for (const QModelIndex &index : indexes) {
+        if (!index.isValid() || index.model() != this) {
+            continue;
+        }
+
+        const Node *node = nodeForIndex(index);
+        if (node->listed || node->listing) {
+            continue;
+        }
+        m_prefetchPool.start(new ListJob(this, pathForNode(node), m_prefetchCancelled, true));
+    }
+}
+
+void SLocalDirModel::cancelPrefetch()
+{
+    *m_prefetchCancelled = true;
+    m_prefetchCancelled = std::make_shared<std::atomic<bool>>(false);
+    m_prefetchPool.clear();
+}
+
+void SLocalDirModel::setExpanded(const QModelIndex &index, bool expanded)
+{
+    if (!index.isValid() || index.model() != this) {
+        return;
+    }
+    m_watcher->setPinned(pathForNode(nodeForIndex(index)), expanded);
+}
+
+void SLocalDirModel::expandToUrl(const QUrl &url)
+{
+    m_pendingExpand = url;
+    m_pendingExpandDepth = 0;
+    m_pendingExpandRelisted = false;
+
+    continueExpanding();
+}
+
+void SLocalDirModel::continueExpanding()
+{
+    if (m_pendingExpand.isEmpty() || !m_root) {
+        return;
+    }
+
+    const QString target = QDir::cleanPath(m_pendingExpand.toLocalFile());
+    QString relativePath;
+    if (m_rootPath == QLatin1String("/")) {
+        relativePath = target.mid(1);
+    } else if (target.startsWith(m_rootPath + QLatin1Char('/'))) {
+        relativePath = target.mid(m_rootPath.length() + 1);
+    } else if (target != m_rootPath) {
+        // Not below our root, nothing to do
+        m_pendingExpand.clear();
+        return;
+    }
+
+    const QStringList components = relativePath.split(QLatin1Char('/'), Qt::SkipEmptyParts);
+    Node *node = m_root.get();
+    for (int depth = 0; depth < components.count(); ++depth) {
+        if (!node->listed) {
+            // We get back here when it's done
+            listNode(node);
+            return;
+        }
+
+        Node *child = nullptr;
+        for (Node *candidate : qAsConst(node->children)) {
+            if (candidate->name == components.at(depth)) {
+                child = candidate;
+                break;
+            }
+        }
+
+        if (!child) {
+            // Might have been created after we listed it, e. g. with "New Folder..."
+            if (!m_pendingExpandRelisted) {
+                m_pendingExpandRelisted = true;
+                listNode(node);
+                return;
+            }
+            m_pendingExpand.clear();
+            return;
+        }
+
+        node = child;
+        if (depth >= m_pendingExpandDepth) {
+            m_pendingExpandDepth = depth + 1;
+            Q_EMIT expand(indexForNode(node));
+        }
+    }
+
+    m_pendingExpand.clear();
+}
+
+QModelIndex SLocalDirModel::index(int row, int column, const QModelIndex &parent) const
+{
+    const Node *parentNode = nodeForIndex(parent);
+    if (!parentNode || column != 0 || row < 0 || row >= parentNode->children.count()) {
+        return QModelIndex();
+    }
+    return createIndex(row, column, parentNode->children.at(row));
+}
+
+QModelIndex SLocalDirModel::parent(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return QModelIndex();
+    }
+
+    Node *parentNode = nodeForIndex(index)->parent;
+    return indexForNode(parentNode);
+}
+
+int SLocalDirModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0) {
+        return 0;
+    }
+
+    const Node *node = nodeForIndex(parent);
+    return node ? node->children.count() : 0;
+}
+
+int SLocalDirModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent)
+    return 1;
+}
+
+QVariant SLocalDirModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid()) {
+        return QVariant();
+    }
+
+    Node *node = nodeForIndex(index);
+    switch (role) {
+    case Qt::DisplayRole:
+    case Qt::EditRole:
+        return node->name;
+    case Qt::DecorationRole:
+        // The plain folder icon until the worker told us better
+        if (node->icon.isNull()) {
+            node->icon = QIcon::fromTheme(node->iconName.isEmpty() ? QStringLiteral("inode-directory") : node->iconName);
+        }
+        return node->icon;
+    case KDirModel::FileItemRole:
+        // Asked for on every paint, only once it won't stat()
+        if (!node->mode) {
+            return QVariant();
+        }
+        return QVariant::fromValue(itemForIndex(index));
+    default:
+        return QVariant();
+    }
+}
+
+Qt::ItemFlags SLocalDirModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return Qt::NoItemFlags;
+    }
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+}
+
+bool SLocalDirModel::hasChildren(const QModelIndex &parent) const
+{
+    if (parent.column() > 0) {
+        return false;
+    }
+
+    const Node *node = nodeForIndex(parent);
+    if (!node) {
+        return false;
+    }
+
+    // Until we know better, like KDirModel
+    if (!node->listed) {
+        return true;
+    }
+    return !node->children.isEmpty();
+}
+
+bool SLocalDirModel::canFetchMore(const QModelIndex &parent) const
+{
+    const Node *node = nodeForIndex(parent);
+    return node && !node->listed && !node->listing;
+}
+
+void SLocalDirModel::fetchMore(const QModelIndex &parent)
+{
+    Node *node = nodeForIndex(parent);
+    if (node && !node->listed) {
+        listNode(node);
+    }
+}
+
+SLocalDirModel::Node *SLocalDirModel::nodeForIndex(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return m_root.get();
+    }
+    return static_cast<Node *>(index.internalPointer());
+}
+
+QModelIndex SLocalDirModel::indexForNode(Node *node) const
+{
+    if (!node || node == m_root.get()) {
+        return QModelIndex();
+    }
+    return createIndex(node->row, 0, node);
+}
+
+SLocalDirModel::Node *SLocalDirModel::nodeForPath(const QString &path) const
+{
+    if (!m_root) {
+        return nullptr;
+    }
+
+    QString relativePath;
+    if (m_rootPath == QLatin1String("/")) {
+        if (!path.startsWith(QLatin1Char('/'))) {
+            return nullptr;
+        }
+        relativePath = path.mid(1);
+    } else if (path.startsWith(m_rootPath + QLatin1Char('/'))) {
+        relativePath = path.mid(m_rootPath.length() + 1);
+    } else if (path != m_rootPath) {
+        return nullptr;
+    }
+
+    Node *node = m_root.get();
+    const QStringList components = relativePath.split(QLatin1Char('/'), Qt::SkipEmptyParts);
+    for (const QString &component : components) {
+        Node *child = nullptr;
+        for (Node *candidate : qAsConst(node->children)) {
+            if (candidate->name == component) {
+                child = candidate;
+                break;
+            }
+        }
+        if (!child) {
+            return nullptr;
+        }
+        node = child;
+    }
+    return node;
+}
+
+QString SLocalDirModel::pathForNode(const Node *node) const
+{
+    QStringList components;
+    for (; node && node != m_root.get(); node = node->parent) {
+        components.prepend(node->name);
+    }
+
+    if (components.isEmpty()) {
+        return m_rootPath;
+    }
+    if (m_rootPath == QLatin1String("/")) {
+        return QLatin1Char('/') + components.join(QLatin1Char('/'));
+    }
+    return m_rootPath + QLatin1Char('/') + components.join(QLatin1Char('/'));
+}
+
+void SLocalDirModel::listNode(Node *node)
+{
+    if (node->listing) {
+        return;
+    }
+    node->listing = true;
+
+    m_threadPool.start(new ListJob(this, pathForNode(node), m_cancelled, false));
+}
+
+void SLocalDirModel::listingFinished(quint64 generation,
+                                     const QString &path,
+                                     const QStringList &names,
+                                     const QStringList &iconNames,
+                                     const QVector<uint> &modes,
+                                     bool ok,
+                                     bool prefetch)
+{
+    if (generation != m_generation) {
+        return;
+    }
+
+    // Might have been removed in the meantime
+    Node *node = nodeForPath(path);
+    if (!node) {
+        return;
+    }
+
+    if (prefetch) {
+        // Leave failures to a real listing, which reports them. Otherwise
+        // this is just as good, and the node expands without waiting.
+        if (!ok) {
+            return;
+        }
+    } else {
+        node->listing = false;
+    }
+    node->listed = true;
+    applyListing(node, ok ? names : QStringList(), ok ? iconNames : QStringList(), ok ? modes : QVector<uint>());
+
+    if (ok) {
+        m_watcher->addPath(path);
+    }
+
+    continueExpanding();
+}
+
+void SLocalDirModel::applyListing(Node *node, const QStringList &names, const QStringList &iconNames, const QVector<uint> &modes)
+{
+    const QSet<QString> newNames(names.begin(), names.end());
+    removeChildren(node, [&newNames](const Node *child) {
+        return !newNames.contains(child->name);
+    });
+    setIconNames(node, names, iconNames, modes);
+    appendChildren(node, names, iconNames, modes);
+
+    // The expand arrow might have to go away
+    const QModelIndex parentIndex = indexForNode(node);
+    if (parentIndex.isValid()) {
+        Q_EMIT dataChanged(parentIndex, parentIndex);
+    }
+}
+
+void SLocalDirModel::removeChildren(Node *node, const std::function<bool(const Node *)> &shouldRemove)
+{
+    const QModelIndex parentIndex = indexForNode(node);
+
+    // In contiguous ranges from the back
+    for (int last = node->children.count() - 1; last >= 0;) {
+        if (!shouldRemove(node->children.at(last))) {
+            last--;
+            continue;
+        }
+
+        int first = last;
+        while (first > 0 && shouldRemove(node->children.at(first - 1))) {
+            first--;
+        }
+
+        beginRemoveRows(parentIndex, first, last);
+        for (int i = first; i <= last; ++i) {
+            delete node->children.at(i);
+        }
+        node->children.remove(first, last - first + 1);
+        for (int i = first; i < node->children.count(); ++i) {
+            node->children.at(i)->row = i;
+        }
+        endRemoveRows();
+
+        last = first - 1;
+    }
+}
+
+void SLocalDirModel::appendChildren(Node *node, const QStringList &names, const QStringList &iconNames, const QVector<uint> &modes)
+{
+    QSet<QString> existingNames;
+    existingNames.reserve(node->children.count());
+    for (const Node *child : qAsConst(node->children)) {
+        existingNames.insert(child->name);
+    }
+
+    QVector<int> added;
+    for (int i = 0; i < names.count(); ++i) {
+        if (!existingNames.contains(names.at(i))) {
+            added.append(i);
+        }
+    }
+
+    if (added.isEmpty()) {
+        return;
+    }
+
+    // In one go, the proxy does the sorting
+    const int first = node->children.count();
+    beginInsertRows(indexForNode(node), first, first + added.count() - 1);
+    for (int i : qAsConst(added)) {
+        Node *child = new Node;
+        child->name = names.at(i);
+        child->iconName = iconNames.value(i);
+        child->mode = modes.value(i);
+        child->parent = node;
+        child->row = node->children.count();
+        node->children.append(child);
+    }
+    endInsertRows();
+}
+
+void SLocalDirModel::setIconNames(Node *node, const QStringList &names, const QStringList &iconNames, const QVector<uint> &modes)
+{
+    QHash<QString, int> indexOf;
+    indexOf.reserve(names.count());
+    for (int i = 0; i < names.count() && i < iconNames.count() && i < modes.count(); ++i) {
+        indexOf.insert(names.at(i), i);
+    }
+
+    for (Node *child : qAsConst(node->children)) {
+        const auto it = indexOf.constFind(child->name);
+        if (it == indexOf.constEnd()) {
+            continue;
+        }
+
+        QVector<int> roles;
+        if (iconNames.at(*it) != child->iconName) {
+            child->iconName = iconNames.at(*it);
+            child->icon = QIcon();
+            roles.append(Qt::DecorationRole);
+        }
+        if (modes.at(*it) != child->mode) {
+            child->mode = modes.at(*it);
+            roles.append(KDirModel::FileItemRole);
+        }
+        if (!roles.isEmpty()) {
+            const QModelIndex index = indexForNode(child);
+            Q_EMIT dataChanged(index, index, roles);
+        }
+    }
+}
+
+void SLocalDirModel::iconsResolved(quint64 generation, const QString &path, const QStringList &names, const QStringList &iconNames, const QVector<uint> &modes)
+{
+    if (generation != m_generation) {
+        return;
+    }
+
+    Node *node = nodeForPath(path);
+    if (node) {
+        setIconNames(node, names, iconNames, modes);
+    }
+}
+
+void SLocalDirModel::entriesChanged(const QString &path, const QStringList &added, const QStringList &removed)
+{
+    Node *node = nodeForPath(path);
+    if (!node || !node->listed) {
+        m_watcher->removePath(path);
+        return;
+    }
+
+    if (!removed.isEmpty()) {
+        const QSet<QString> removedNames(removed.begin(), removed.end());
+        removeChildren(node, [&removedNames](const Node *child) {
+            return removedNames.contains(child->name);
+        });
+    }
+
+    // Something that is still there might have been replaced, what we know
+    // about what's below it is worthless then
+    for (Node *child : qAsConst(node->children)) {
+        if (child->listed && added.contains(child->name)) {
+            listNode(child);
+        }
+    }
+    appendChildren(node, added, QStringList(), QVector<uint>());
+    if (!added.isEmpty()) {
+        m_threadPool.start(new IconJob(this, path, added, m_cancelled));
+    }
+
+    const QModelIndex parentIndex = indexForNode(node);
+    if (parentIndex.isValid()) {
+        Q_EMIT dataChanged(parentIndex, parentIndex);
+    }
+}
+
+void SLocalDirModel::directoryChanged(const QString &path)
+{
+    Node *node = nodeForPath(path);
+    if (!node || !node->listed) {
+        m_watcher->removePath(path);
+        return;
+    }
+
+    listNode(node);
+}
+
+void SLocalDirModel::watchEvicted(const QString &path)
+{
+    // Nobody tells us about changes in there anymore, so list it again the
+    // next time it's expanded. The rows stay until then.
+    Node *node = nodeForPath(path);
+    if (node) {
+        node->listed = false;
+    }
+}
+
+#include "moc_slocaldirmodel.cpp"
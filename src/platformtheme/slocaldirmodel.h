@@ -0,0 +1,162 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef SLOCALDIRMODEL_H
+#define SLOCALDIRMODEL_H
+
+#include <QAbstractItemModel>
+#include <QThreadPool>
+#include <QUrl>
+#include <QVector>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class KFileItem;
+class SDirWatcher;
+
+/**
+ * A tree model of the directories below a local root directory.
+ *
+ * This is the local, directory only, fast path of KFileTreeView. Instead of
+ * going through KDirLister (which stats every entry, creates KFileItems and
+ * resolves mimetypes just for the files to be filtered out again) entries
+ * are enumerated in a worker thread with readdir(), and the type from the
+ * dirent is used to skip everything that isn't a directory before anything
+ * else is done with it.
+ *
+ * Hidden directories are always listed, KFileTreeView filters them in its
+ * proxy. The subset of the KDirModel API it uses is mirrored here.
+ *
+ * Listed directories are watched with SDirWatcher, and changes are applied
+ * as they come in. Only a limited number of directories is watched; when a
+ * collapsed one has to make room, it is listed again the next time it's
+ * expanded.
+ */
+class SLocalDirModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    explicit SLocalDirModel(QObject *parent = nullptr);
+    ~SLocalDirModel() override;
+
+    /**
+     * Clears the model and starts listing the local directory @p url.
+     */
+    void openUrl(const QUrl &url);
+
+    /**
+     * Returns the root url, as given to openUrl().
+     */
+    QUrl rootUrl() const;
+
+    /**
+     * Returns the index for @p url, or an invalid index if it isn't listed (yet).
+     */
+    QModelIndex indexForUrl(const QUrl &url) const;
+
+    /**
+     * Returns the url of @p index.
+     */
+    QUrl urlForIndex(const QModelIndex &index) const;
+
+    /**
+     * Returns a file item for @p index, with the permissions the listing
+     * found, so it doesn't stat() when asked for them. Directories that
+     * showed up through the watcher have none until the worker threads got
+     * to them, their items stat() on first use until then.
+     */
+    KFileItem itemForIndex(const QModelIndex &index) const;
+
+    /**
+     * Lists the not yet listed directories in @p indexes in the background,
+     * with a low, bounded concurrency. Meant for the rows that are visible,
+     * so their expand arrows are right and expanding them is immediate.
+     *
+     * Cancels what is left of the previous call.
+     */
+    void prefetch(const QModelIndexList &indexes);
+
+    /**
+     * Tells the model whether @p index is expanded in the view. Expanded
+     * directories stay watched, collapsed ones may be dropped.
+     */
+    void setExpanded(const QModelIndex &index, bool expanded);
+
+    /**
+     * Lists all directories from the root down to @p url, and emits
+     * expand() for each of them as they become available.
+     */
+    void expandToUrl(const QUrl &url);
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &index) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
+Q_SIGNALS:
+    /**
+     * Emitted by expandToUrl() for every directory on the way.
+     */
+    void expand(const QModelIndex &index);
+
+private:
+    struct Node;
+    class ListJob;
+    class IconJob;
+
+    Node *nodeForIndex(const QModelIndex &index) const;
+    QModelIndex indexForNode(Node *node) const;
+    Node *nodeForPath(const QString &path) const;
+    QString pathForNode(const Node *node) const;
+
+    void listNode(Node *node);
+    void cancelPrefetch();
+    void listingFinished(quint64 generation,
+                         const QString &path,
+                         const QStringList &names,
+                         const QStringList &iconNames,
+                         const QVector<uint> &modes,
+                         bool ok,
+                         bool prefetch);
+    void iconsResolved(quint64 generation, const QString &path, const QStringList &names, const QStringList &iconNames, const QVector<uint> &modes);
+    void applyListing(Node *node, const QStringList &names, const QStringList &iconNames, const QVector<uint> &modes);
+    void removeChildren(Node *node, const std::function<bool(const Node *)> &shouldRemove);
+    void appendChildren(Node *node, const QStringList &names, const QStringList &iconNames, const QVector<uint> &modes);
+    void setIconNames(Node *node, const QStringList &names, const QStringList &iconNames, const QVector<uint> &modes);
+    void continueExpanding();
+    void entriesChanged(const QString &path, const QStringList &added, const QStringList &removed);
+    void directoryChanged(const QString &path);
+    void watchEvicted(const QString &path);
+
+    std::unique_ptr<Node> m_root;
+    QString m_rootPath;
+
+    // Bumped on every openUrl(), so results for the old tree are dropped
+    quint64 m_generation = 0;
+    std::shared_ptr<std::atomic<bool>> m_cancelled;
+    QThreadPool m_threadPool;
+
+    // Separate, so pending prefetches can be dropped without touching
+    // listings somebody is waiting for
+    std::shared_ptr<std::atomic<bool>> m_prefetchCancelled;
+    QThreadPool m_prefetchPool;
+
+    QUrl m_pendingExpand;
+    int m_pendingExpandDepth = 0;
+    bool m_pendingExpandRelisted = false;
+
+    SDirWatcher *m_watcher;
+};
+
+#endif
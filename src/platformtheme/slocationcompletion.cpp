@@ -0,0 +1,171 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "slocationcompletion.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileSystemWatcher>
+#include <QPointer>
+#include <QUrl>
+
+// Keeps the number of inotify watches (and memory) bounded
+static const int s_maxIndexedDirectories = 64;
+
+SDirectoryIndex *SDirectoryIndex::self()
+{
+    // Owned by the application, so the watcher goes away before QCoreApplication does
+    static QPointer<SDirectoryIndex> s_self;
+    if (!s_self) {
+        s_self = new SDirectoryIndex(QCoreApplication::instance());
+    }
+    return s_self;
+}
+
+SDirectoryIndex::SDirectoryIndex(QObject *parent)
+    : QObject(parent)
+    , m_watcher(new QFileSystemWatcher(this))
+{
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, &SDirectoryIndex::directoryChanged);
+}
+
+void SDirectoryIndex::visit(const QString &path)
+{
+    touch(path);
+}
+
+void SDirectoryIndex::touch(const QString &path)
+{
+    if (!m_recent.isEmpty() && m_recent.last() == path) {
+        return;
+    }
+
+    if (m_recent.removeOne(path)) {
+        m_recent.append(path);
+        return;
+    }
+
+    m_recent.append(path);
+    m_entries.insert(path, Entry());
+
+    while (m_recent.count() > s_maxIndexedDirectories) {
+        const QString evicted = m_recent.takeFirst();
+        if (m_entries.take(evicted).listed) {
+            m_watcher->removePath(evicted);
+        }
+    }
+}
+
+QStringList SDirectoryIndex::entries(const QString &path, bool *ok)
+{
+    touch(path);
+
+    Entry &entry = m_entries[path];
+    if (entry.listed) {
+        *ok = true;
+        return entry.names;
+    }
+
+    const QDir dir(path);
+    if (!dir.exists() || !dir.isReadable()) {
+        *ok = false;
+        return QStringList();
+    }
+
+    // QDirIterator gets the type from the dirent, so this doesn't stat
+    // every entry unless it has to (symlinks)
+    entry.names.clear();
+    QDirIterator it(path, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        entry.names.append(info.isDir() ? info.fileName() + QLatin1Char('/') : info.fileName());
+    }
+    entry.listed = true;
+    m_watcher->addPath(path);
+
+    *ok = true;
+    return entry.names;
+}
+
+void SDirectoryIndex::directoryChanged(const QString &path)
+{
+    // Relisted the next time it's needed, no point in doing it now
+    QHash<QString, Entry>::iterator it = m_entries.find(path);
+    if (it != m_entries.end()) {
+        it->listed = false;
+        it->names.clear();
+    }
+    m_watcher->removePath(path);
+}
+
+SLocationCompletion::SLocationCompletion(QObject *parent)
+    : KUrlCompletion(KUrlCompletion::FileCompletion)
+{
+    setParent(parent);
+}
+
+SLocationCompletion::~SLocationCompletion()
+{
+}
+
+void SLocationCompletion::setDir(const QUrl &dir)
+{
+    KUrlCompletion::setDir(dir);
+
+    if (dir.isLocalFile()) {
+        SDirectoryIndex::self()->visit(QDir::cleanPath(dir.toLocalFile()));
+    }
+}
+
+QUrl SLocationCompletion::urlForMatch(const QString &match) const
+{
+    if (QDir::isAbsolutePath(match)) {
+        return QUrl::fromLocalFile(match);
+    }
+
+    QUrl url = dir();
+    url.setPath(QDir::cleanPath(url.path() + QLatin1Char('/') + match));
+    return url;
+}
+
+QString SLocationCompletion::makeCompletion(const QString &text)
+{
+    // Leave everything that needs expanding or KIO to KUrlCompletion
+    if (text.isEmpty() || text.startsWith(QLatin1Char('~')) || text.startsWith(QLatin1Char('$')) || text.contains(QLatin1String(":/"))) {
+        return KUrlCompletion::makeCompletion(text);
+    }
+
+    const bool absolute = QDir::isAbsolutePath(text);
+    if (!absolute && !dir().isLocalFile()) {
+        return KUrlCompletion::makeCompletion(text);
+    }
+
+    // What the user typed up to the last slash is kept as is, we only complete the last part
+    const QString typedDir = text.left(text.lastIndexOf(QLatin1Char('/')) + 1);
+    const QString path = absolute ? QDir::cleanPath(typedDir) : QDir::cleanPath(dir().toLocalFile() + QLatin1Char('/') + typedDir);
+
+    bool ok = false;
+    const QStringList names = SDirectoryIndex::self()->entries(path, &ok);
+    if (!ok) {
+        return KUrlCompletion::makeCompletion(text);
+    }
+
+    // Don't let a listing job started for an earlier text overwrite our items
+    stop();
+
+    QStringList items;
+    items.reserve(names.count());
+    for (const QString &name : names) {
+        items.append(typedDir + name);
+    }
+    setItems(items);
+
+    return KCompletion::makeCompletion(text);
+}
+
+#include "moc_slocationcompletion.cpp"
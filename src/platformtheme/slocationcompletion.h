@@ -0,0 +1,86 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <KUrlCompletion>
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+
+class QFileSystemWatcher;
+
+/**
+ * Process wide index of the names in recently visited local directories.
+ *
+ * Directories are listed the first time someone asks for them, and are
+ * then kept until they change on disk (we get told through inotify by
+ * QFileSystemWatcher) or fall out of the most recently used set.
+ */
+class SDirectoryIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    static SDirectoryIndex *self();
+
+    /**
+     * Marks @p path as recently visited, without listing it.
+     */
+    void visit(const QString &path);
+
+    /**
+     * Returns the names in @p path, with a trailing slash for directories.
+     * Sets @p ok to false if the directory can't be read.
+     */
+    QStringList entries(const QString &path, bool *ok);
+
+private Q_SLOTS:
+    void directoryChanged(const QString &path);
+
+private:
+    explicit SDirectoryIndex(QObject *parent);
+    void touch(const QString &path);
+
+    struct Entry {
+        QStringList names;
+        bool listed = false;
+    };
+
+    QHash<QString, Entry> m_entries;
+    QStringList m_recent; // most recently used last
+    QFileSystemWatcher *m_watcher;
+};
+
+/**
+ * Completion for the location edit of the file dialog.
+ *
+ * Local paths are completed from SDirectoryIndex without starting any
+ * listing jobs, everything else (remote urls, ~user, $VARS) is handed
+ * to KUrlCompletion.
+ */
+class SLocationCompletion : public KUrlCompletion
+{
+    Q_OBJECT
+
+public:
+    explicit SLocationCompletion(QObject *parent = nullptr);
+    ~SLocationCompletion() override;
+
+    /**
+     * Sets the directory relative paths are completed in, and marks it as
+     * recently visited.
+     */
+    void setDir(const QUrl &dir) override;
+
+    /**
+     * Returns the url for a completion @p match.
+     */
+    QUrl urlForMatch(const QString &match) const;
+
+    QString makeCompletion(const QString &text) override;
+};
@@ -0,0 +1,441 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "smediapreview.h"
+#include "smediapreview_p.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QLabel>
+#include <QLocale>
+#include <QMimeDatabase>
+#include <QPair>
+#include <QUrl>
+#include <QVBoxLayout>
+
+#include <klocalizedstring.h>
+#include <kio/global.h>
+
+namespace
+{
+
+// Headers and tags we care about live in the first or last few kilobytes
+const qint64 s_headBytes = 64 * 1024;
+const qint64 s_tailBytes = 4 * 1024;
+
+using SMediaPreviewParsers::Summary;
+
+quint32 readBigEndian32(const QByteArray &data, int pos)
+{
+    const uchar *d = reinterpret_cast<const uchar *>(data.constData()) + pos;
+    return (quint32(d[0]) << 24) | (quint32(d[1]) << 16) | (quint32(d[2]) << 8) | quint32(d[3]);
+}
+
+quint32 readLittleEndian32(const QByteArray &data, int pos)
+{
+    const uchar *d = reinterpret_cast<const uchar *>(data.constData()) + pos;
+    return (quint32(d[3]) << 24) | (quint32(d[2]) << 16) | (quint32(d[1]) << 8) | quint32(d[0]);
+}
+
+quint32 readSyncSafe32(const QByteArray &data, int pos)
+{
+    const uchar *d = reinterpret_cast<const uchar *>(data.constData()) + pos;
+    return (quint32(d[0] & 0x7f) << 21) | (quint32(d[1] & 0x7f) << 14) | (quint32(d[2] & 0x7f) << 7) | quint32(d[3] & 0x7f);
+}
+
+QString decodeUtf16(const char *data, int length, bool bigEndian)
+{
+    QString result;
+    result.reserve(length / 2);
+    const uchar *d = reinterpret_cast<const uchar *>(data);
+    for (int i = 0; i + 1 < length; i += 2) {
+        const ushort c = bigEndian ? ushort((d[i] << 8) | d[i + 1]) : ushort((d[i + 1] << 8) | d[i]);
+        result.append(QChar(c));
+    }
+    return result;
+}
+
+QString formatDuration(quint64 seconds)
+{
+    if (seconds >= 3600) {
+        return QStringLiteral("%1:%2:%3")
+            .arg(seconds / 3600)
+            .arg((seconds / 60) % 60, 2, 10, QLatin1Char('0'))
+            .arg(seconds % 60, 2, 10, QLatin1Char('0'));
+    }
+    return QStringLiteral("%1:%2").arg(seconds / 60).arg(seconds % 60, 2, 10, QLatin1Char('0'));
+}
+
+// Text frame content, first byte is the encoding
+QString decodeId3Text(const QByteArray &frame)
+{
+    if (frame.isEmpty()) {
+        return QString();
+    }
+
+    const char *text = frame.constData() + 1;
+    const int length = frame.size() - 1;
+    QString result;
+    switch (frame.at(0)) {
+    case 0: // ISO-8859-1
+        result = QString::fromLatin1(text, length);
+        break;
+    case 1: { // UTF-16 with BOM
+        if (length < 2) {
+            return QString();
+        }
+        const bool bigEndian = uchar(text[0]) == 0xfe && uchar(text[1]) == 0xff;
+        result = decodeUtf16(text + 2, length - 2, bigEndian);
+        break;
+    }
+    case 2: // UTF-16BE
+        result = decodeUtf16(text, length, true);
+        break;
+    case 3: // UTF-8
+        result = QString::fromUtf8(text, length);
+        break;
+    default:
+        return QString();
+    }
+
+    // Multiple values are separated by NUL, we only show the first one
+    const int nul = result.indexOf(QChar(0));
+    if (nul >= 0) {
+        result.truncate(nul);
+    }
+    return result.trimmed();
+}
+
+} // namespace
+
+void SMediaPreviewParsers::readId3v2(const QByteArray &head, Summary *summary)
+{
+    if (head.size() < 10 || !head.startsWith("ID3")) {
+        return;
+    }
+
+    const int majorVersion = head.at(3);
+    if (majorVersion != 3 && majorVersion != 4) {
+        return;
+    }
+
+    const int tagEnd = int(qMin(qint64(head.size()), 10 + qint64(readSyncSafe32(head, 6))));
+    int pos = 10;
+    if (head.at(5) & 0x40) { // extended header
+        if (pos + 4 > tagEnd) {
+            return;
+        }
+        // The v2.3 size leaves out the size field itself, the v2.4 one doesn't
+        const qint64 extendedSize = majorVersion == 3 ? 4 + qint64(readBigEndian32(head, pos)) : qint64(readSyncSafe32(head, pos));
+        if (extendedSize < 4 || extendedSize > tagEnd - pos) {
+            return;
+        }
+        pos += int(extendedSize);
+    }
+
+    QString title, artist, album;
+    while (pos + 10 <= tagEnd) {
+        const QByteArray id = head.mid(pos, 4);
+        if (id.at(0) == '\0') { // padding
+            break;
+        }
+        const quint32 frameSize = majorVersion == 4 ? readSyncSafe32(head, pos + 4) : readBigEndian32(head, pos + 4);
+        pos += 10;
+        if (frameSize == 0 || frameSize > quint32(tagEnd - pos)) {
+            break;
+        }
+
+        if (id == "TIT2") {
+            title = decodeId3Text(head.mid(pos, int(frameSize)));
+        } else if (id == "TPE1") {
+            artist = decodeId3Text(head.mid(pos, int(frameSize)));
+        } else if (id == "TALB") {
+            album = decodeId3Text(head.mid(pos, int(frameSize)));
+        }
+        pos += int(frameSize);
+    }
+
+    if (!title.isEmpty()) {
+        summary->append(qMakePair(i18n("Title:"), title));
+    }
+    if (!artist.isEmpty()) {
+        summary->append(qMakePair(i18n("Artist:"), artist));
+    }
+    if (!album.isEmpty()) {
+        summary->append(qMakePair(i18n("Album:"), album));
+    }
+}
+
+void SMediaPreviewParsers::readId3v1(const QByteArray &tail, Summary *summary)
+{
+    if (tail.size() < 128) {
+        return;
+    }
+    const QByteArray tag = tail.right(128);
+    if (!tag.startsWith("TAG")) {
+        return;
+    }
+
+    const auto field = [&tag](int offset) {
+        return QString::fromLatin1(tag.mid(offset, 30).constData()).trimmed();
+    };
+
+    const QString title = field(3);
+    const QString artist = field(33);
+    const QString album = field(63);
+    if (!title.isEmpty()) {
+        summary->append(qMakePair(i18n("Title:"), title));
+    }
+    if (!artist.isEmpty()) {
+        summary->append(qMakePair(i18n("Artist:"), artist));
+    }
+    if (!album.isEmpty()) {
+        summary->append(qMakePair(i18n("Album:"), album));
+    }
+}
+
+void SMediaPreviewParsers::readFlac(const QByteArray &head, Summary *summary)
+{
+    if (!head.startsWith("fLaC")) {
+        return;
+    }
+
+    QString title, artist, album, duration;
+    int pos = 4;
+    bool last = false;
+    while (!last && pos + 4 <= head.size()) {
+        const uchar blockHeader = uchar(head.at(pos));
+        last = blockHeader & 0x80;
+        const int type = blockHeader & 0x7f;
+        const int length = int(readBigEndian32(head, pos) & 0xffffff);
+        pos += 4;
+        if (length > head.size() - pos) {
+            break;
+        }
+
+        if (type == 0 && length >= 18) { // STREAMINFO
+            const uchar *d = reinterpret_cast<const uchar *>(head.constData()) + pos;
+            const quint32 sampleRate = (quint32(d[10]) << 12) | (quint32(d[11]) << 4) | (d[12] >> 4);
+            const quint64 totalSamples = (quint64(d[13] & 0x0f) << 32) | readBigEndian32(head, pos + 14);
+            if (sampleRate > 0 && totalSamples > 0) {
+                duration = formatDuration(totalSamples / sampleRate);
+            }
+        } else if (type == 4 && length >= 8) { // VORBIS_COMMENT, little endian
+            const int end = pos + length;
+            const quint32 vendorLength = readLittleEndian32(head, pos);
+            if (vendorLength <= quint32(end - pos - 8)) {
+                int p = pos + 4 + int(vendorLength);
+                quint32 count = readLittleEndian32(head, p);
+                p += 4;
+                while (count-- > 0 && p + 4 <= end) {
+                    const quint32 commentLength = readLittleEndian32(head, p);
+                    p += 4;
+                    if (commentLength > quint32(end - p)) {
+                        break;
+                    }
+                    const QString comment = QString::fromUtf8(head.constData() + p, int(commentLength));
+                    p += int(commentLength);
+
+                    const int separator = comment.indexOf(QLatin1Char('='));
+                    const QString key = comment.left(separator).toUpper();
+                    const QString value = comment.mid(separator + 1).trimmed();
+                    if (key == QLatin1String("TITLE")) {
+                        title = value;
+                    } else if (key == QLatin1String("ARTIST")) {
+                        artist = value;
+                    } else if (key == QLatin1String("ALBUM")) {
+                        album = value;
+                    }
+                }
+            }
+        }
+        pos += length;
+    }
+
+    if (!title.isEmpty()) {
+        summary->append(qMakePair(i18n("Title:"), title));
+    }
+    if (!artist.isEmpty()) {
+        summary->append(qMakePair(i18n("Artist:"), artist));
+    }
+    if (!album.isEmpty()) {
+        summary->append(qMakePair(i18n("Album:"), album));
+    }
+    if (!duration.isEmpty()) {
+        summary->append(qMakePair(i18n("Duration:"), duration));
+    }
+}
+
+namespace
+{
+
+// Only handles plain literal strings, which is what most writers produce
+QString readPdfString(const QByteArray &data, const QByteArray &key)
+{
+    int pos = data.indexOf(key);
+    if (pos < 0) {
+        return QString();
+    }
+    pos += key.size();
+    while (pos < data.size() && (data.at(pos) == ' ' || data.at(pos) == '\r' || data.at(pos) == '\n')) {
+        pos++;
+    }
+    if (pos >= data.size() || data.at(pos) != '(') {
+        return QString();
+    }
+    pos++;
+
+    QByteArray value;
+    int depth = 0;
+    for (; pos < data.size(); pos++) {
+        const char c = data.at(pos);
+        if (c == '\\' && pos + 1 < data.size()) {
+            value.append(data.at(++pos));
+            continue;
+        }
+        if (c == '(') {
+            depth++;
+        } else if (c == ')') {
+            if (depth == 0) {
+                break;
+            }
+            depth--;
+        }
+        value.append(c);
+    }
+
+    if (value.startsWith("\xfe\xff")) {
+        return decodeUtf16(value.constData() + 2, value.size() - 2, true).trimmed();
+    }
+    return QString::fromLatin1(value).trimmed();
+}
+
+} // namespace
+
+void SMediaPreviewParsers::readPdf(const QByteArray &head, const QByteArray &tail, Summary *summary)
+{
+    // The header is allowed to be somewhere in the first kilobyte
+    const QByteArray start = head.left(1024);
+    const int headerPos = start.indexOf("%PDF-");
+    if (headerPos < 0) {
+        return;
+    }
+    summary->append(qMakePair(i18n("Version:"), QString::fromLatin1(start.mid(headerPos + 5, 3))));
+
+    // Linearized files tell us the page count right away
+    if (start.contains("/Linearized")) {
+        int pos = start.indexOf("/N ");
+        if (pos > 0) {
+            pos += 3;
+            int end = pos;
+            while (end < start.size() && start.at(end) >= '0' && start.at(end) <= '9') {
+                end++;
+            }
+            if (end > pos) {
+                summary->append(qMakePair(i18n("Pages:"), QString::fromLatin1(start.mid(pos, end - pos))));
+            }
+        }
+    }
+
+    QString title = readPdfString(head, "/Title");
+    if (title.isEmpty()) {
+        title = readPdfString(tail, "/Title");
+    }
+    if (!title.isEmpty()) {
+        summary->append(qMakePair(i18n("Title:"), title));
+    }
+}
+
+SMediaPreview::SMediaPreview(QWidget *parent)
+    : KPreviewWidgetBase(parent)
+{
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+
+    m_label = new QLabel(this);
+    m_label->setAlignment(Qt::AlignTop | Qt::AlignLeft);
+    m_label->setTextFormat(Qt::RichText);
+    m_label->setWordWrap(true);
+    layout->addWidget(m_label);
+
+    setSupportedMimeTypes(QStringList{
+        QStringLiteral("application/pdf"),
+        QStringLiteral("audio/*"),
+        QStringLiteral("video/*"),
+    });
+}
+
+SMediaPreview::~SMediaPreview()
+{
+}
+
+QSize SMediaPreview::sizeHint() const
+{
+    return QSize(200, 200);
+}
+
+void SMediaPreview::showPreview(const QUrl &url)
+{
+    m_label->clear();
+
+    if (!url.isLocalFile()) {
+        return;
+    }
+
+    const QString path = url.toLocalFile();
+    const QFileInfo info(path);
+
+    Summary summary;
+    summary.append(qMakePair(i18n("Type:"), QMimeDatabase().mimeTypeForFile(info).comment()));
+    summary.append(qMakePair(i18n("Size:"), KIO::convertSize(KIO::filesize_t(info.size()))));
+    summary.append(qMakePair(i18n("Modified:"), QLocale().toString(info.lastModified(), QLocale::ShortFormat)));
+
+    QFile file(path);
+    if (file.open(QIODevice::ReadOnly)) {
+        const qint64 fileSize = file.size();
+        const qint64 headSize = qMin(fileSize, s_headBytes);
+        const qint64 tailSize = qMin(fileSize, s_tailBytes);
+
+        QByteArray head;
+        const uchar *data = headSize > 0 ? file.map(0, headSize) : nullptr;
+        if (data) {
+            head = QByteArray(reinterpret_cast<const char *>(data), int(headSize));
+            file.unmap(const_cast<uchar *>(data));
+        } else {
+            head = file.read(headSize);
+        }
+
+        QByteArray tail;
+        if (file.seek(fileSize - tailSize)) {
+            tail = file.read(tailSize);
+        }
+
+        if (head.startsWith("ID3")) {
+            SMediaPreviewParsers::readId3v2(head, &summary);
+        } else if (head.startsWith("fLaC")) {
+            SMediaPreviewParsers::readFlac(head, &summary);
+        } else if (head.left(1024).contains("%PDF-")) {
+            SMediaPreviewParsers::readPdf(head, tail, &summary);
+        } else {
+            SMediaPreviewParsers::readId3v1(tail, &summary);
+        }
+    }
+
+    QString html = QStringLiteral("<table>");
+    for (const QPair<QString, QString> &entry : qAsConst(summary)) {
+        html += QStringLiteral("<tr><td><b>%1</b></td><td>%2</td></tr>")
+            .arg(entry.first.toHtmlEscaped(), entry.second.toHtmlEscaped());
+    }
+    html += QStringLiteral("</table>");
+    m_label->setText(html);
+}
+
+void SMediaPreview::clearPreview()
+{
+    m_label->clear();
+}
+
+#include "moc_smediapreview.cpp"
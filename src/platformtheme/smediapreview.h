@@ -0,0 +1,37 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <kpreviewwidgetbase.h>
+
+class QLabel;
+
+/**
+ * Shows a short metadata summary for documents and media files (PDF, audio,
+ * video).
+ *
+ * Nothing is decoded or rendered, we only look at the first and last few
+ * kilobytes of the file for headers and tags, so it stays cheap for huge
+ * files.
+ */
+class SMediaPreview : public KPreviewWidgetBase
+{
+    Q_OBJECT
+
+public:
+    explicit SMediaPreview(QWidget *parent = nullptr);
+    ~SMediaPreview() override;
+
+    QSize sizeHint() const override;
+
+public Q_SLOTS:
+    void showPreview(const QUrl &url) override;
+    void clearPreview() override;
+
+private:
+    QLabel *m_label;
+};
@@ -0,0 +1,32 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef SMEDIAPREVIEW_P_H
+#define SMEDIAPREVIEW_P_H
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+/**
+ * The header and tag readers of SMediaPreview.
+ *
+ * They get whatever bytes the file had, so every length read from the data
+ * is checked against what's left before it's used.
+ */
+namespace SMediaPreviewParsers
+{
+// Label and value, in the order they're shown
+typedef QList<QPair<QString, QString>> Summary;
+
+void readId3v2(const QByteArray &head, Summary *summary);
+void readId3v1(const QByteArray &tail, Summary *summary);
+void readFlac(const QByteArray &head, Summary *summary);
+void readPdf(const QByteArray &head, const QByteArray &tail, Summary *summary);
+}
+
+#endif
@@ -0,0 +1,301 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "smountwatcher.h"
+#include "smountwatcher_p.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QPointer>
+#include <QSocketNotifier>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+
+const QLatin1String s_mountInfoPath("/proc/self/mountinfo");
+
+// Device node to link name, for the links udev keeps in @p dir
+QHash<QString, QString> readDiskLinks(const QString &dir)
+{
+    QHash<QString, QString> links;
+    const QFileInfoList entries = QDir(dir).entryInfoList(QDir::System | QDir::Files | QDir::NoDotAndDotDot);
+    for (const QFileInfo &entry : entries) {
+        const QString target = entry.canonicalFilePath();
+        if (!target.isEmpty() && !links.contains(target)) {
+            links.insert(target, entry.fileName());
+        }
+    }
+    return links;
+}
+
+QByteArray readSysFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll().trimmed();
+}
+
+bool isRemovableBlockDevice(const QByteArray &majorMinor)
+{
+    QString sysPath = QFileInfo(QStringLiteral("/sys/dev/block/") + QLatin1String(majorMinor)).canonicalFilePath();
+    if (sysPath.isEmpty()) {
+        return false;
+    }
+
+    // Hotplugged disks often claim not to be removable, but they are for us
+    if (sysPath.contains(QLatin1String("/usb")) || sysPath.contains(QLatin1String("/mmc"))) {
+        return true;
+    }
+
+    // The removable flag is on the disk, not on its partitions
+    if (QFile::exists(sysPath + QLatin1String("/partition"))) {
+        sysPath = QFileInfo(sysPath).path();
+    }
+    return readSysFile(sysPath + QLatin1String("/removable")) == "1";
+}
+
+}
+
+// Mounted below these is the system's business, not the user's
+bool SMountWatcherParsers::isSystemMountPoint(const QString &mountPoint)
+{
+    static const QStringList systemDirs = {
+        QStringLiteral("/boot"),
+        QStringLiteral("/efi"),
+        QStringLiteral("/proc"),
+        QStringLiteral("/sys"),
+        QStringLiteral("/dev"),
+        QStringLiteral("/snap"),
+        QStringLiteral("/var/lib/snapd"),
+    };
+    for (const QString &dir : systemDirs) {
+        if (mountPoint == dir || mountPoint.startsWith(dir + QLatin1Char('/'))) {
+            return true;
+        }
+    }
+
+    // udisks mounts things for the user in /run/media
+    if (mountPoint.startsWith(QLatin1String("/run/"))) {
+        return !mountPoint.startsWith(QLatin1String("/run/media/"));
+    }
+    return false;
+}
+
+bool SMountWatcherParsers::isNetworkFileSystem(const QString &type)
+{
+    return type == QLatin1String("nfs") || type == QLatin1String("nfs4") || type == QLatin1String("cifs") || type == QLatin1String("smb3")
+        || type == QLatin1String("smbfs") || type == QLatin1String("fuse.sshfs");
+}
+
+// mountinfo escapes space, tab, newline and backslash as \ooo
+QString SMountWatcherParsers::unescapeOctal(const QByteArray &field)
+{
+    if (!field.contains('\\')) {
+        return QFile::decodeName(field);
+    }
+
+    QByteArray result;
+    result.reserve(field.size());
+    for (int i = 0; i < field.size(); ++i) {
+        if (field.at(i) == '\\' && i + 3 < field.size() && field.at(i + 1) >= '0' && field.at(i + 1) <= '7') {
+            result.append(char(field.mid(i + 1, 3).toInt(nullptr, 8)));
+            i += 3;
+        } else {
+            result.append(field.at(i));
+        }
+    }
+    return QFile::decodeName(result);
+}
+
+// The names in /dev/disk/by-label escape anything odd as \xNN
+QString SMountWatcherParsers::unescapeHex(const QString &name)
+{
+    if (!name.contains(QLatin1Char('\\'))) {
+        return name;
+    }
+
+    QByteArray result;
+    const QByteArray encoded = QFile::encodeName(name);
+    for (int i = 0; i < encoded.size(); ++i) {
+        if (encoded.at(i) == '\\' && i + 3 < encoded.size() && encoded.at(i + 1) == 'x') {
+            result.append(char(encoded.mid(i + 2, 2).toInt(nullptr, 16)));
+            i += 3;
+        } else {
+            result.append(encoded.at(i));
+        }
+    }
+    return QString::fromUtf8(result);
+}
+
+QVector<SMountWatcherParsers::Entry> SMountWatcherParsers::parseMountInfo(const QByteArray &contents)
+{
+    QVector<Entry> entries;
+    const QList<QByteArray> lines = contents.split('\n');
+    for (const QByteArray &line : lines) {
+        // id parent major:minor root mountpoint options [optional...] - type source superoptions
+        const QList<QByteArray> fields = line.split(' ');
+        const int separator = fields.indexOf("-", 6);
+        if (separator < 0 || separator + 2 >= fields.count()) {
+            continue;
+        }
+
+        Entry entry;
+        entry.majorMinor = fields.at(2);
+        entry.mountPoint = unescapeOctal(fields.at(4));
+        entry.fileSystemType = QString::fromLatin1(fields.at(separator + 1));
+        entry.source = unescapeOctal(fields.at(separator + 2));
+        entries.append(entry);
+    }
+    return entries;
+}
+
+bool SMountWatcher::Mount::operator==(const Mount &other) const
+{
+    return udi == other.udi && mountPoint == other.mountPoint && device == other.device && fileSystemType == other.fileSystemType
+        && label == other.label && removable == other.removable && network == other.network;
+}
+
+SMountWatcher *SMountWatcher::self()
+{
+    static QPointer<SMountWatcher> s_self;
+    if (!s_self) {
+        s_self = new SMountWatcher(QCoreApplication::instance());
+    }
+    return s_self;
+}
+
+SMountWatcher::SMountWatcher(QObject *parent)
+    : QObject(parent)
+{
+    m_fd = open(s_mountInfoPath.data(), O_RDONLY | O_CLOEXEC);
+    if (m_fd >= 0) {
+        // The kernel wakes up poll() with POLLPRI when the table changes,
+        // that's the exception condition to QSocketNotifier
+        m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Exception, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &SMountWatcher::readMountInfo);
+    }
+
+    readMountInfo();
+}
+
+SMountWatcher::~SMountWatcher()
+{
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+QStringList SMountWatcher::udis() const
+{
+    return m_udis;
+}
+
+SMountWatcher::Mount SMountWatcher::mount(const QString &udi) const
+{
+    return m_mounts.value(udi);
+}
+
+void SMountWatcher::readMountInfo()
+{
+    if (m_fd < 0) {
+        return;
+    }
+
+    // Has to be read from the start in one go, it's generated on read
+    QByteArray contents;
+    if (lseek(m_fd, 0, SEEK_SET) == 0) {
+        char buffer[16384];
+        for (;;) {
+            const ssize_t n = read(m_fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                contents.append(buffer, n);
+            } else if (n == 0 || errno != EINTR) {
+                break;
+            }
+        }
+    }
+
+    const QHash<QString, QString> uuids = readDiskLinks(QStringLiteral("/dev/disk/by-uuid"));
+    const QHash<QString, QString> labels = readDiskLinks(QStringLiteral("/dev/disk/by-label"));
+
+    QHash<QString, Mount> mounts;
+    QStringList udis;
+
+    const QVector<SMountWatcherParsers::Entry> entries = SMountWatcherParsers::parseMountInfo(contents);
+    for (const SMountWatcherParsers::Entry &entry : entries) {
+        Mount mount;
+        mount.mountPoint = entry.mountPoint;
+        mount.fileSystemType = entry.fileSystemType;
+        const QString &source = entry.source;
+        mount.network = SMountWatcherParsers::isNetworkFileSystem(mount.fileSystemType);
+
+        if (SMountWatcherParsers::isSystemMountPoint(mount.mountPoint)) {
+            continue;
+        }
+
+        if (mount.network) {
+            mount.device = source;
+            mount.udi = mount.fileSystemType + QLatin1Char(':') + source;
+            mount.label = source;
+        } else if (source.startsWith(QLatin1String("/dev/"))) {
+            // Loop devices are snaps and disk images, not drives
+            if (source.startsWith(QLatin1String("/dev/loop"))) {
+                continue;
+            }
+
+            const QString node = QFileInfo(source).canonicalFilePath();
+            mount.device = node.isEmpty() ? source : node;
+            const QString uuid = uuids.value(mount.device);
+            mount.udi = uuid.isEmpty() ? QStringLiteral("dev:") + mount.device : QStringLiteral("uuid:") + uuid;
+            mount.label = SMountWatcherParsers::unescapeHex(labels.value(mount.device));
+            mount.removable = isRemovableBlockDevice(entry.majorMinor);
+        } else {
+            continue;
+        }
+
+        // Bind mounts and btrfs subvolumes show up more than once, the
+        // first one is where the thing was mounted in the first place
+        if (mounts.contains(mount.udi)) {
+            continue;
+        }
+        mounts.insert(mount.udi, mount);
+        udis.append(mount.udi);
+    }
+
+    QStringList added;
+    QStringList removed;
+    QStringList changed;
+    for (const QString &udi : std::as_const(udis)) {
+        const auto it = m_mounts.constFind(udi);
+        if (it == m_mounts.constEnd()) {
+            added.append(udi);
+        } else if (*it != mounts.value(udi)) {
+            changed.append(udi);
+        }
+    }
+    for (const QString &udi : std::as_const(m_udis)) {
+        if (!mounts.contains(udi)) {
+            removed.append(udi);
+        }
+    }
+
+    m_mounts = mounts;
+    m_udis = udis;
+
+    if (!added.isEmpty() || !removed.isEmpty() || !changed.isEmpty()) {
+        Q_EMIT mountsChanged(added, removed, changed);
+    }
+}
+
+#include "moc_smountwatcher.cpp"
@@ -0,0 +1,79 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef SMOUNTWATCHER_H
+#define SMOUNTWATCHER_H
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+
+class QSocketNotifier;
+
+/**
+ * The mounted storage devices and network shares, for the places model.
+ *
+ * Reads /proc/self/mountinfo, and reads it again whenever the kernel flags
+ * it as changed, which it does by waking up poll() on it. Nothing in here
+ * touches the mounted filesystems themselves, so a dead network mount can't
+ * block us; whether a drive is removable comes from sysfs.
+ *
+ * There's one instance per process, like there's one mount table.
+ */
+class SMountWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Mount {
+        // Stable across remounts where possible, based on the filesystem UUID
+        QString udi;
+        QString mountPoint;
+        QString device;
+        QString fileSystemType;
+        QString label;
+        bool removable = false;
+        bool network = false;
+
+        bool operator==(const Mount &other) const;
+        bool operator!=(const Mount &other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    static SMountWatcher *self();
+    ~SMountWatcher() override;
+
+    /**
+     * Returns the udis of all mounts, in mount order.
+     */
+    QStringList udis() const;
+
+    /**
+     * Returns the mount with @p udi, or an empty Mount.
+     */
+    Mount mount(const QString &udi) const;
+
+Q_SIGNALS:
+    /**
+     * Emitted once for every change of the mount table, with the udis of
+     * the mounts that appeared, went away or changed in some other way.
+     */
+    void mountsChanged(const QStringList &added, const QStringList &removed, const QStringList &changed);
+
+private:
+    explicit SMountWatcher(QObject *parent);
+
+    void readMountInfo();
+
+    int m_fd = -1;
+    QSocketNotifier *m_notifier = nullptr;
+    QHash<QString, Mount> m_mounts;
+    QStringList m_udis;
+};
+
+#endif
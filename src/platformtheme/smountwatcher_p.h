@@ -0,0 +1,37 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef SMOUNTWATCHER_P_H
+#define SMOUNTWATCHER_P_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+/**
+ * The parts of SMountWatcher that only look at text, what the kernel and
+ * udev give us, without going to the system.
+ */
+namespace SMountWatcherParsers
+{
+struct Entry {
+    QByteArray majorMinor;
+    QString mountPoint;
+    QString fileSystemType;
+    QString source;
+};
+
+// The lines of /proc/self/mountinfo, skipping any that are cut short
+QVector<Entry> parseMountInfo(const QByteArray &contents);
+
+QString unescapeOctal(const QByteArray &field);
+QString unescapeHex(const QString &name);
+
+bool isSystemMountPoint(const QString &mountPoint);
+bool isNetworkFileSystem(const QString &type);
+}
+
+#endif
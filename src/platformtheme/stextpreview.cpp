@@ -0,0 +1,96 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "stextpreview.h"
+
+#include <QFile>
+#include <QFontDatabase>
+#include <QPlainTextEdit>
+#include <QUrl>
+#include <QVBoxLayout>
+
+// Enough to fill the preview pane a couple of times over
+static const qint64 s_maxPreviewBytes = 16 * 1024;
+
+STextPreview::STextPreview(QWidget *parent)
+    : KPreviewWidgetBase(parent)
+{
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+
+    m_textEdit = new QPlainTextEdit(this);
+    m_textEdit->setReadOnly(true);
+    m_textEdit->setLineWrapMode(QPlainTextEdit::NoWrap);
+    m_textEdit->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    m_textEdit->setFocusPolicy(Qt::NoFocus);
+    layout->addWidget(m_textEdit);
+
+    // Everything inheriting text/plain (source files, scripts, etc.) is
+    // resolved to us by SFileMetaPreview
+    setSupportedMimeTypes(QStringList{QStringLiteral("text/plain")});
+}
+
+STextPreview::~STextPreview()
+{
+}
+
+QSize STextPreview::sizeHint() const
+{
+    return QSize(200, 200);
+}
+
+void STextPreview::showPreview(const QUrl &url)
+{
+    m_textEdit->clear();
+
+    // We don't want to start KIO jobs for this, remote files aren't previewed
+    if (!url.isLocalFile()) {
+        return;
+    }
+
+    QFile file(url.toLocalFile());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    const qint64 size = qMin(file.size(), s_maxPreviewBytes);
+    if (size <= 0) {
+        return;
+    }
+
+    const uchar *data = file.map(0, size);
+    QByteArray bytes;
+    if (data) {
+        // Deep copy, the mapping goes away with the file
+        bytes = QByteArray(reinterpret_cast<const char *>(data), int(size));
+        file.unmap(const_cast<uchar *>(data));
+    } else {
+        // Some filesystems (e. g. procfs) can't be mapped
+        bytes = file.read(size);
+    }
+
+    // Probably misdetected, don't show garbage
+    if (bytes.contains('\0')) {
+        return;
+    }
+
+    // Avoid ending on half a line (and possibly half a character)
+    if (size < file.size()) {
+        const int lastNewline = bytes.lastIndexOf('\n');
+        if (lastNewline > 0) {
+            bytes.truncate(lastNewline);
+        }
+    }
+
+    m_textEdit->setPlainText(QString::fromUtf8(bytes));
+}
+
+void STextPreview::clearPreview()
+{
+    m_textEdit->clear();
+}
+
+#include "moc_stextpreview.cpp"
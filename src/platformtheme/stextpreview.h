@@ -0,0 +1,35 @@
+/*
+    This file is part of the KDE project
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <kpreviewwidgetbase.h>
+
+class QPlainTextEdit;
+
+/**
+ * Shows the beginning of plain text and source files.
+ *
+ * Only the first few kilobytes of the file are mapped and decoded, so the
+ * size of the file does not matter.
+ */
+class STextPreview : public KPreviewWidgetBase
+{
+    Q_OBJECT
+
+public:
+    explicit STextPreview(QWidget *parent = nullptr);
+    ~STextPreview() override;
+
+    QSize sizeHint() const override;
+
+public Q_SLOTS:
+    void showPreview(const QUrl &url) override;
+    void clearPreview() override;
+
+private:
+    QPlainTextEdit *m_textEdit;
+};
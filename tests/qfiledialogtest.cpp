@@ -22,9 +22,248 @@
 #include <QFileDialog>
 #include <QCommandLineParser>
 #include <QDebug>
+#include <QAbstractItemView>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QPointer>
+#include <QTemporaryDir>
+#include <QTimer>
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <unistd.h>
+
+namespace
+{
+
+class FirstPaintWatcher : public QObject
+{
+public:
+    explicit FirstPaintWatcher(const QElapsedTimer &timer)
+        : m_timer(timer)
+    {
+    }
+
+    qint64 elapsed = -1;
+
+protected:
+    bool eventFilter(QObject *object, QEvent *event) override
+    {
+        if (elapsed < 0 && event->type() == QEvent::Paint) {
+            elapsed = m_timer.elapsed();
+        }
+        return QObject::eventFilter(object, event);
+    }
+
+private:
+    const QElapsedTimer &m_timer;
+};
+
+qint64 residentSetSizeKiB()
+{
+    QFile statm(QStringLiteral("/proc/self/statm"));
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.count() < 2) {
+        return 0;
+    }
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+// Tells when any view of a visible window shows at least fileCount rows.
+// The views are looked for now and then, the rows are counted when their
+// models say something changed.
+class PopulatedWatcher : public QObject
+{
+public:
+    explicit PopulatedWatcher(int fileCount)
+        : m_fileCount(fileCount)
+    {
+        m_scanTimer.setInterval(50);
+        connect(&m_scanTimer, &QTimer::timeout, this, &PopulatedWatcher::scan);
+        m_scanTimer.start();
+    }
+
+    std::function<void()> populated;
+
+private:
+    void scan()
+    {
+        const QWidgetList windows = QApplication::topLevelWidgets();
+        for (QWidget *window : windows) {
+            if (!window->isVisible()) {
+                continue;
+            }
+            const QList<QAbstractItemView *> views = window->findChildren<QAbstractItemView *>();
+            for (QAbstractItemView *view : views) {
+                QAbstractItemModel *model = view->model();
+                if (model && !m_models.contains(model)) {
+                    m_models.append(model);
+                    connect(model, &QAbstractItemModel::rowsInserted, this, &PopulatedWatcher::check);
+                    connect(model, &QAbstractItemModel::modelReset, this, &PopulatedWatcher::check);
+                    connect(model, &QAbstractItemModel::layoutChanged, this, &PopulatedWatcher::check);
+                }
+                if (!m_views.contains(view)) {
+                    m_views.append(view);
+                }
+            }
+        }
+        // A view might have been pointed at a folder that's filled already
+        check();
+    }
+
+    void check()
+    {
+        if (!m_scanTimer.isActive()) {
+            return;
+        }
+        for (const QPointer<QAbstractItemView> &view : std::as_const(m_views)) {
+            if (view && view->model() && view->model()->rowCount(view->rootIndex()) >= m_fileCount) {
+                m_scanTimer.stop();
+                populated();
+                return;
+            }
+        }
+    }
+
+    const int m_fileCount;
+    QTimer m_scanTimer;
+    QList<QPointer<QAbstractItemView>> m_views;
+    QList<QPointer<QAbstractItemModel>> m_models;
+};
+
+// Whether the dialog on screen is ours and not the one of Qt, which is
+// what QFileDialog falls back to when the platform theme isn't loaded
+bool platformDialogShown()
+{
+    const QWidgetList windows = QApplication::topLevelWidgets();
+    return std::any_of(windows.cbegin(), windows.cend(), [](const QWidget *window) {
+        return window->isVisible() && window->inherits("KDEPlatformFileDialogBase");
+    });
+}
+
+qint64 median(QList<qint64> values)
+{
+    if (values.isEmpty()) {
+        return -1;
+    }
+    std::sort(values.begin(), values.end());
+    return values.at(values.count() / 2);
+}
+
+int runBenchmark(int iterations, const QStringList &fileCounts, qint64 timeout)
+{
+    if (iterations <= 0) {
+        qWarning() << "Invalid iteration count" << iterations;
+        return 1;
+    }
+    if (timeout <= 0) {
+        qWarning() << "Invalid timeout" << timeout;
+        return 1;
+    }
+
+    int failures = 0;
+
+    for (const QString &fileCountString : fileCounts) {
+        const int fileCount = fileCountString.toInt();
+        if (fileCount <= 0) {
+            qWarning() << "Invalid file count" << fileCountString;
+            return 1;
+        }
+
+        QTemporaryDir dir;
+        if (!dir.isValid()) {
+            qWarning() << "Can't create a temporary directory:" << dir.errorString();
+            return 1;
+        }
+        for (int i = 0; i < fileCount; ++i) {
+            QFile file(dir.path() + QStringLiteral("/file%1.txt").arg(i, 6, 10, QLatin1Char('0')));
+            if (!file.open(QIODevice::WriteOnly)) {
+                qWarning() << "Can't create" << file.fileName() << file.errorString();
+                return 1;
+            }
+        }
+
+        QList<qint64> firstPaints;
+        QList<qint64> populateds;
+        const qint64 rssBefore = residentSetSizeKiB();
+
+        for (int iteration = 0; iteration < iterations; ++iteration) {
+            QElapsedTimer timer;
+            FirstPaintWatcher paintWatcher(timer);
+            qApp->installEventFilter(&paintWatcher);
+
+            timer.start();
+            QFileDialog *dialog = new QFileDialog(nullptr, QStringLiteral("Benchmark"), dir.path());
+            dialog->open();
+            if (!platformDialogShown()) {
+                qWarning() << "The dialog isn't the one of the platform theme, is QT_QPA_PLATFORMTHEME pointing somewhere else?";
+                qApp->removeEventFilter(&paintWatcher);
+                delete dialog;
+                return 1;
+            }
+
+            qint64 populated = -1;
+            QEventLoop loop;
+            PopulatedWatcher populatedWatcher(fileCount);
+            populatedWatcher.populated = [&]() {
+                populated = timer.elapsed();
+                loop.quit();
+            };
+            QTimer::singleShot(int(qBound<qint64>(0, timeout - timer.elapsed(), std::numeric_limits<int>::max())), &loop, &QEventLoop::quit);
+            loop.exec();
+
+            qApp->removeEventFilter(&paintWatcher);
+            dialog->reject();
+            delete dialog;
+            QCoreApplication::processEvents();
+
+            if (populated < 0) {
+                qWarning() << "Timed out waiting for" << fileCount << "files to show up";
+                failures++;
+            } else {
+                populateds.append(populated);
+            }
+            if (paintWatcher.elapsed >= 0) {
+                firstPaints.append(paintWatcher.elapsed);
+            }
+        }
+
+        const qint64 rssAfter = residentSetSizeKiB();
+        printf("files: %7d  iterations: %3d  first paint: %5lld ms  populated: %6lld ms  rss growth: %6lld KiB\n",
+               fileCount, iterations,
+               static_cast<long long>(median(firstPaints)),
+               static_cast<long long>(median(populateds)),
+               static_cast<long long>(rssAfter - rssBefore));
+        fflush(stdout);
+    }
+
+    return failures > 0 ? 1 : 0;
+}
+
+}
 
 int main(int argc, char **argv)
 {
+    // The benchmark doesn't need a display, but it needs our dialog. Keep
+    // whatever the user asked for, though.
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--benchmark") != 0) {
+            continue;
+        }
+        if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+        }
+        if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORMTHEME")) {
+            qputenv("QT_QPA_PLATFORMTHEME", "sandsmark");
+        }
+    }
+
     QApplication app(argc, argv);
     app.setQuitOnLastWindowClosed(false);
     app.setApplicationName(QStringLiteral("QFileDialogTest"));
@@ -41,8 +280,18 @@ int main(int argc, char **argv)
     parser.addOption(QCommandLineOption(QStringList(QStringLiteral("selectFile")), QStringLiteral("Initially selected file"), QStringLiteral("filename")));
     parser.addOption(QCommandLineOption(QStringList(QStringLiteral("selectDirectory")), QStringLiteral("Initially selected directory"), QStringLiteral("dirname")));
     parser.addOption(QCommandLineOption(QStringList(QStringLiteral("modal")), QStringLiteral("Test modal dialog"), QStringLiteral("modality"), QStringLiteral("on")));
+    parser.addOption(QCommandLineOption(QStringList(QStringLiteral("benchmark")), QStringLiteral("Open and close the dialog repeatedly on generated directories and print timings, uses the offscreen platform and the sandsmark platform theme unless QT_QPA_PLATFORM or QT_QPA_PLATFORMTHEME are set")));
+    parser.addOption(QCommandLineOption(QStringList(QStringLiteral("iterations")), QStringLiteral("Number of times to open the dialog per directory in benchmark mode"), QStringLiteral("count"), QStringLiteral("10")));
+    parser.addOption(QCommandLineOption(QStringList(QStringLiteral("fileCounts")), QStringLiteral("Comma separated number of files in the generated directories in benchmark mode"), QStringLiteral("counts"), QStringLiteral("1000,10000,100000")));
+    parser.addOption(QCommandLineOption(QStringList(QStringLiteral("timeout")), QStringLiteral("Time to wait for the view to be populated in benchmark mode"), QStringLiteral("milliseconds"), QStringLiteral("60000")));
     parser.process(app);
 
+    if (parser.isSet(QStringLiteral("benchmark"))) {
+        return runBenchmark(parser.value(QStringLiteral("iterations")).toInt(),
+                            parser.value(QStringLiteral("fileCounts")).split(QLatin1Char(','), Qt::SkipEmptyParts),
+                            parser.value(QStringLiteral("timeout")).toLongLong());
+    }
+
     const QString staticFunction = parser.value(QStringLiteral("staticFunction"));
     if (staticFunction == QLatin1String("getExistingDirectory")) {
         QString dir = QFileDialog::getExistingDirectory(nullptr, QStringLiteral("getExistingDirectory test"), QStringLiteral("/tmp"));